@@ -34,6 +34,11 @@
 #define TASDEVICE_CLK_DIR_IN		(0)
 #define TASDEVICE_CLK_DIR_OUT		(1)
 
+static bool sync_ctl_writes;
+module_param(sync_ctl_writes, bool, 0644);
+MODULE_PARM_DESC(sync_ctl_writes,
+	"Volume controls wait until their value is on the amps");
+
 static int tasdevice_program_get(struct snd_kcontrol *pKcontrol,
 		struct snd_ctl_elem_value *pValue)
 {
@@ -248,6 +253,7 @@ void powercontrol_routine(struct work_struct *work)
 		goto out;
 	}
 	mutex_lock(&tas_dev->codec_lock);
+	tasdevice_regbin_swap(tas_dev);
 
 	if (fw && tas_dev->cur_prog == 0) {
 		/*dsp mode or tuning mode*/
@@ -411,6 +417,7 @@ static int tasdevice_codec_probe(struct snd_soc_component *codec)
 	/* Codec Lock Hold */
 	mutex_lock(&tas_priv->codec_lock);
 	tas_priv->codec = codec;
+	tas_priv->regbin_reload_off = false;
 
 	scnprintf(tas_priv->regbin_binaryname, 64, "%s-%uamp-reg.bin",
 		tas_priv->dev_name, tas_priv->ndev);
@@ -445,6 +452,8 @@ static void tasdevice_codec_remove(
 {
 	struct tasdevice_priv *tas_dev =
 		snd_soc_component_get_drvdata(codec);
+
+	tasdevice_regbin_reload_stop(tas_dev);
 	/* Codec Lock Hold */
 	mutex_lock(&tas_dev->codec_lock);
 	tasdevice_deinit(tas_dev);
@@ -467,6 +476,183 @@ static const struct snd_soc_component_driver
 	.endianness		= 1,
 };
 
+/*
+ * Volume put handlers only park the new value in a per-register slot and
+ * kick ctl_work, which writes whatever is latest to all amps. A slider
+ * producing updates faster than the bus can take them costs one write
+ * per register and amp per drain instead of one per update.
+ */
+static int tasdevice_ctl_apply(struct tasdevice_priv *tas_dev,
+	struct tasdevice_ctl_write *w)
+{
+	int i, ret = 0, err;
+
+	tasdevice_prio_begin(tas_dev);
+	if (!w->mask && tas_dev->set_global_mode != NULL) {
+		if (w->len == 1)
+			ret = tasdevice_dev_write(tas_dev, tas_dev->ndev,
+				w->reg, w->val[0]);
+		else
+			ret = tasdevice_dev_bulk_write(tas_dev, tas_dev->ndev,
+				w->reg, w->val, w->len);
+		if (ret)
+			dev_err(tas_dev->dev,
+				"%s, set 0x%x error in global mode\n",
+				__func__, w->reg);
+		goto out;
+	}
+
+	for (i = 0; i < tas_dev->ndev; i++) {
+		if (w->mask)
+			err = tasdevice_dev_update_bits(tas_dev, i, w->reg,
+				w->mask, w->val[0]);
+		else if (w->len == 1)
+			err = tasdevice_dev_write(tas_dev, i, w->reg,
+				w->val[0]);
+		else
+			err = tasdevice_dev_bulk_write(tas_dev, i, w->reg,
+				w->val, w->len);
+		if (err) {
+			dev_err(tas_dev->dev,
+				"%s, set 0x%x error in device %d\n",
+				__func__, w->reg, i);
+			ret = err;
+		}
+	}
+out:
+	tasdevice_prio_end(tas_dev);
+	return ret;
+}
+
+void tasdevice_ctl_work(struct work_struct *work)
+{
+	struct tasdevice_priv *tas_dev =
+		container_of(work, struct tasdevice_priv, ctl_work);
+	struct tasdevice_ctl_write w;
+	int i;
+
+	for (i = 0; i < TASDEVICE_CTL_SLOTS; i++) {
+		spin_lock_irq(&tas_dev->ctl_lock);
+		if (!tas_dev->ctl_writes[i].pending) {
+			spin_unlock_irq(&tas_dev->ctl_lock);
+			continue;
+		}
+		w = tas_dev->ctl_writes[i];
+		/* Hand the slot back, a later put may take it right away */
+		tas_dev->ctl_writes[i].pending = false;
+		tas_dev->ctl_writes[i].len = 0;
+		spin_unlock_irq(&tas_dev->ctl_lock);
+
+		tasdevice_ctl_apply(tas_dev, &w);
+	}
+}
+
+/*
+ * Keep control writes off the bus while the chips' book/page selection
+ * and register cache are reset underneath them (hardware reset, resume).
+ * Puts meanwhile are parked in their slots and go out on release.
+ */
+void tasdevice_ctl_hold(struct tasdevice_priv *tas_dev)
+{
+	spin_lock_irq(&tas_dev->ctl_lock);
+	tas_dev->ctl_hold++;
+	spin_unlock_irq(&tas_dev->ctl_lock);
+	flush_work(&tas_dev->ctl_work);
+}
+
+void tasdevice_ctl_release(struct tasdevice_priv *tas_dev)
+{
+	bool kick = false;
+	int i;
+
+	spin_lock_irq(&tas_dev->ctl_lock);
+	if (!--tas_dev->ctl_hold)
+		for (i = 0; i < TASDEVICE_CTL_SLOTS; i++)
+			kick |= tas_dev->ctl_writes[i].pending;
+	spin_unlock_irq(&tas_dev->ctl_lock);
+	if (kick)
+		queue_work(system_highpri_wq, &tas_dev->ctl_work);
+}
+
+static int tasdevice_ctl_queue(struct tasdevice_priv *tas_dev,
+	unsigned int reg, unsigned int mask, const unsigned char *val,
+	unsigned char len)
+{
+	struct tasdevice_ctl_write *w = NULL, tmp;
+	int i;
+
+	tmp.reg = reg;
+	tmp.mask = mask;
+	tmp.len = len;
+	memcpy(tmp.val, val, len);
+
+	spin_lock_irq(&tas_dev->ctl_lock);
+	for (i = 0; i < TASDEVICE_CTL_SLOTS; i++) {
+		if (tas_dev->ctl_writes[i].len &&
+			(tas_dev->ctl_writes[i].reg != reg ||
+			tas_dev->ctl_writes[i].mask != mask))
+			continue;
+		w = &tas_dev->ctl_writes[i];
+		break;
+	}
+	if (tas_dev->ctl_hold) {
+		if (!w) {
+			spin_unlock_irq(&tas_dev->ctl_lock);
+			return -EBUSY;
+		}
+		*w = tmp;
+		w->pending = true;
+		spin_unlock_irq(&tas_dev->ctl_lock);
+		return 0;
+	}
+	if (sync_ctl_writes) {
+		/*
+		 * This value supersedes whatever is parked for the register.
+		 * Drop it, wait out an older value ctl_work may be writing
+		 * right now, then apply our own and report its status.
+		 */
+		if (w && w->len) {
+			w->pending = false;
+			w->len = 0;
+		}
+		spin_unlock_irq(&tas_dev->ctl_lock);
+		flush_work(&tas_dev->ctl_work);
+		return tasdevice_ctl_apply(tas_dev, &tmp);
+	}
+	if (!w) {
+		spin_unlock_irq(&tas_dev->ctl_lock);
+		/* Out of slots, no reason to drop the value */
+		return tasdevice_ctl_apply(tas_dev, &tmp);
+	}
+	*w = tmp;
+	w->pending = true;
+	spin_unlock_irq(&tas_dev->ctl_lock);
+
+	queue_work(system_highpri_wq, &tas_dev->ctl_work);
+	return 0;
+}
+
+/* A get right after a put reports the value still on its way */
+static bool tasdevice_ctl_peek(struct tasdevice_priv *tas_dev,
+	unsigned int reg, unsigned char *val, unsigned char len)
+{
+	bool found = false;
+	int i;
+
+	spin_lock_irq(&tas_dev->ctl_lock);
+	for (i = 0; i < TASDEVICE_CTL_SLOTS; i++) {
+		if (!tas_dev->ctl_writes[i].pending ||
+			tas_dev->ctl_writes[i].reg != reg ||
+			tas_dev->ctl_writes[i].len != len)
+			continue;
+		memcpy(val, tas_dev->ctl_writes[i].val, len);
+		found = true;
+		break;
+	}
+	spin_unlock_irq(&tas_dev->ctl_lock);
+	return found;
+}
+
 static int tas2563_digital_getvol(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
@@ -482,7 +668,8 @@ static int tas2563_digital_getvol(struct snd_kcontrol *kcontrol,
 	int ret = 0;
 
 	/* Read the primary device as the whole */
-	ret = tasdevice_dev_bulk_read(tas_dev, 0, mc->reg, data, 4);
+	if (!tasdevice_ctl_peek(tas_dev, mc->reg, data, 4))
+		ret = tasdevice_dev_bulk_read(tas_dev, 0, mc->reg, data, 4);
 	if (ret) {
 		dev_err(tas_dev->dev,
 		"%s, get digital vol error\n",
@@ -510,7 +697,6 @@ static int tas2563_digital_putvol(struct snd_kcontrol *kcontrol,
 	unsigned short val;
 	unsigned int vol;
 	unsigned char *p;
-	int i, ret = 0;
 	__be32 mackey;
 
 	val = ucontrol->value.integer.value[0];
@@ -520,27 +706,7 @@ static int tas2563_digital_putvol(struct snd_kcontrol *kcontrol,
 	p[2] = 0xFF;
 	p[3] = 0xff;
 
-	if (tas_dev->set_global_mode != NULL) {
-		ret = tasdevice_dev_bulk_write(tas_dev, tas_dev->ndev,
-			mc->reg, p, 4);
-		if (ret)
-			dev_err(tas_dev->dev,
-				"%s, set digital vol error in global mode\n",
-				__func__);
-		goto out;
-	}
-
-	for (i = 0; i < tas_dev->ndev; i++) {
-		ret = tasdevice_dev_bulk_write(tas_dev, i,
-			mc->reg, p, 4);
-		if (ret)
-			dev_err(tas_dev->dev,
-				"%s, set digital vol error in device %d\n",
-				__func__, i);
-	}
-
-out:
-	return ret;
+	return tasdevice_ctl_queue(tas_dev, mc->reg, 0, p, 4);
 }
 
 static int tasdevice_digital_getvol(struct snd_kcontrol *kcontrol,
@@ -550,11 +716,15 @@ static int tasdevice_digital_getvol(struct snd_kcontrol *kcontrol,
 	struct tasdevice_priv *tas_dev = snd_soc_component_get_drvdata(codec);
 	struct soc_mixer_control *mc =
 		(struct soc_mixer_control *)kcontrol->private_value;
+	unsigned char pending;
 	unsigned int val;
 	int ret = 0;
 
 	/* Read the primary device as the whole */
-	ret = tasdevice_dev_read(tas_dev, 0, mc->reg, &val);
+	if (tasdevice_ctl_peek(tas_dev, mc->reg, &pending, 1))
+		val = pending;
+	else
+		ret = tasdevice_dev_read(tas_dev, 0, mc->reg, &val);
 	if (ret) {
 		dev_err(tas_dev->dev, "%s, get digital vol error\n", __func__);
 		goto out;
@@ -574,28 +744,16 @@ static int tasdevice_digital_putvol(struct snd_kcontrol *kcontrol,
 	struct tasdevice_priv *tas_dev = snd_soc_component_get_drvdata(codec);
 	struct soc_mixer_control *mc =
 		(struct soc_mixer_control *)kcontrol->private_value;
+	unsigned char byte;
 	unsigned int val;
-	int i, ret = 0;
 
 	val = ucontrol->value.integer.value[0];
 	val = (val > mc->max) ? mc->max : val;
 	val = mc->invert ? mc->max - val : val;
 	val = (val < 0) ? 0 : val;
-	if (tas_dev->set_global_mode != NULL) {
-		ret = tasdevice_dev_write(tas_dev, tas_dev->ndev, mc->reg, val);
-		if (ret)
-			dev_err(tas_dev->dev, "%s, set digital vol error in global mode\n",
-				__func__);
-	} else {
-		for (i = 0; i < tas_dev->ndev; i++) {
-			ret = tasdevice_dev_write(tas_dev, i, mc->reg, val);
-			if (ret)
-				dev_err(tas_dev->dev,
-					"%s, set digital vol error in device %d\n", __func__, i);
-		}
-	}
+	byte = val;
 
-	return ret;
+	return tasdevice_ctl_queue(tas_dev, mc->reg, 0, &byte, 1);
 }
 
 static int tasdevice_amp_getvol(struct snd_kcontrol *kcontrol,
@@ -605,12 +763,15 @@ static int tasdevice_amp_getvol(struct snd_kcontrol *kcontrol,
 	struct tasdevice_priv *tas_dev = snd_soc_component_get_drvdata(codec);
 	struct soc_mixer_control *mc =
 		(struct soc_mixer_control *)kcontrol->private_value;
-	unsigned char mask = 0;
+	unsigned char mask = 0, pending;
 	unsigned int val;
 	int ret = 0;
 
 	/* Read the primary device */
-	ret = tasdevice_dev_read(tas_dev, 0, mc->reg, &val);
+	if (tasdevice_ctl_peek(tas_dev, mc->reg, &pending, 1))
+		val = pending;
+	else
+		ret = tasdevice_dev_read(tas_dev, 0, mc->reg, &val);
 	if (ret) {
 		dev_err(tas_dev->dev, "%s, get AMP vol error\n", __func__);
 		goto out;
@@ -634,9 +795,8 @@ static int tasdevice_amp_putvol(struct snd_kcontrol *kcontrol,
 	struct tasdevice_priv *tas_dev = snd_soc_component_get_drvdata(codec);
 	struct soc_mixer_control *mc =
 		(struct soc_mixer_control *)kcontrol->private_value;
-	unsigned char mask = 0;
+	unsigned char mask = 0, byte;
 	unsigned int val;
-	int i, ret = 0;
 
 	mask = (1 << fls(mc->max)) - 1;
 	mask <<= mc->shift;
@@ -644,16 +804,9 @@ static int tasdevice_amp_putvol(struct snd_kcontrol *kcontrol,
 	val = (val > mc->max) ? mc->max : val;
 	val = mc->invert ? mc->max - val : val;
 	val = (val < 0) ? 0 : val;
+	byte = val << mc->shift;
 
-	for (i = 0; i < tas_dev->ndev; i++) {
-		ret = tasdevice_dev_update_bits(tas_dev, i, mc->reg, mask,
-			val << mc->shift);
-		if (ret)
-			dev_err(tas_dev->dev, "%s, set AMP vol error in device %d\n",
-				__func__, i);
-	}
-
-	return ret;
+	return tasdevice_ctl_queue(tas_dev, mc->reg, mask, &byte, 1);
 }
 
 static const DECLARE_TLV_DB_SCALE(tas2563_amp_vol_tlv, 800, 50, 0);
@@ -691,12 +844,11 @@ static int tasdevice_info_rotation(struct snd_kcontrol *kcontrol,
 	/* Codec Lock Hold*/
 	mutex_lock(&tas_priv->codec_lock);
 	uinfo->count = 1;
-	/* Codec Lock Release*/
-	mutex_unlock(&tas_priv->codec_lock);
-
 	uinfo->value.integer.min = tas_priv->mtRegbin.direct_rotation_cfg_id;
 	uinfo->value.integer.max = tas_priv->mtRegbin.direct_rotation_cfg_id
 		+ tas_priv->mtRegbin.direct_rotation_cfg_total - 1;
+	/* Codec Lock Release*/
+	mutex_unlock(&tas_priv->codec_lock);
 
 	return 0;
 }
@@ -708,14 +860,14 @@ static int tasdevice_set_rotation_id(struct snd_kcontrol *kcontrol,
 		= snd_soc_kcontrol_component(kcontrol);
 	struct tasdevice_priv *tas_priv =
 		snd_soc_component_get_drvdata(codec);
-	int max_val = tas_priv->mtRegbin.direct_rotation_cfg_id
-		+ tas_priv->mtRegbin.direct_rotation_cfg_total - 1;
-	int min_val = tas_priv->mtRegbin.direct_rotation_cfg_id;
 	int val = ucontrol->value.integer.value[0];
+	int min_val, max_val;
 
-	tas_priv->mtRegbin.rotation_id = clamp(val, min_val, max_val);
 	/* Codec Lock Hold*/
 	mutex_lock(&tas_priv->codec_lock);
+	min_val = tas_priv->mtRegbin.direct_rotation_cfg_id;
+	max_val = min_val + tas_priv->mtRegbin.direct_rotation_cfg_total - 1;
+	tas_priv->mtRegbin.rotation_id = clamp(val, min_val, max_val);
 	tasdevice_select_cfg_blk(tas_priv, val, TASDEVICE_BIN_BLK_PRE_POWER_UP);
 	/* Codec Lock Release*/
 	mutex_unlock(&tas_priv->codec_lock);
@@ -754,11 +906,10 @@ static int tasdevice_info_profile(struct snd_kcontrol *kcontrol,
 	/* Codec Lock Hold*/
 	mutex_lock(&tas_priv->codec_lock);
 	uinfo->count = 1;
-	/* Codec Lock Release*/
-	mutex_unlock(&tas_priv->codec_lock);
-
 	uinfo->value.integer.min = 0;
 	uinfo->value.integer.max = tas_priv->mtRegbin.ncfgs - 1;
+	/* Codec Lock Release*/
+	mutex_unlock(&tas_priv->codec_lock);
 
 	return 0;
 }
@@ -770,13 +921,12 @@ static int tasdevice_get_profile_id(struct snd_kcontrol *kcontrol,
 		= snd_soc_kcontrol_component(kcontrol);
 	struct tasdevice_priv *tas_priv
 		= snd_soc_component_get_drvdata(codec);
-	int val = tas_priv->mtRegbin.profile_cfg_id;
-	int max_val = tas_priv->mtRegbin.ncfgs - 1;
-	int ret = 0;
+	int val, ret = 0;
 
-	val = clamp(val, 0, max_val);
 	/* Codec Lock Hold*/
 	mutex_lock(&tas_priv->codec_lock);
+	val = clamp(tas_priv->mtRegbin.profile_cfg_id, 0,
+		tas_priv->mtRegbin.ncfgs - 1);
 	if (ucontrol->value.integer.value[0] != val) {
 		ucontrol->value.integer.value[0] = val;
 		ret = 1;
@@ -794,13 +944,12 @@ static int tasdevice_set_profile_id(struct snd_kcontrol *kcontrol,
 		= snd_soc_kcontrol_component(kcontrol);
 	struct tasdevice_priv *tas_priv =
 		snd_soc_component_get_drvdata(codec);
-	int max_val = tas_priv->mtRegbin.ncfgs - 1;
 	int val = ucontrol->value.integer.value[0];
 	int ret = 0;
 
-	val = clamp(val, 0, max_val);
 	/* Codec Lock Hold*/
 	mutex_lock(&tas_priv->codec_lock);
+	val = clamp(val, 0, tas_priv->mtRegbin.ncfgs - 1);
 	if (tas_priv->mtRegbin.profile_cfg_id != val) {
 		tas_priv->mtRegbin.profile_cfg_id = val;
 		ret = 1;
@@ -20,4 +20,7 @@ int tasdevice_create_controls(struct tasdevice_priv *tas_priv);
 int tasdevice_dsp_create_control(struct tasdevice_priv
 	*tas_priv);
 void powercontrol_routine(struct work_struct *work);
+void tasdevice_ctl_work(struct work_struct *work);
+void tasdevice_ctl_hold(struct tasdevice_priv *tas_dev);
+void tasdevice_ctl_release(struct tasdevice_priv *tas_dev);
 #endif
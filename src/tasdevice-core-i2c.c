@@ -23,39 +23,178 @@
 #include <linux/pm.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
-#include <linux/version.h>
 
 #include "tasdevice.h"
 #include "tasdevice-rw.h"
 #include "tasdevice-node.h"
+#include "tasdevice-regmap.h"
+#include "tas2563-reg.h"
+#include "tas2781-reg.h"
 #ifndef CONFIG_TASDEV_CODEC_SPI
 
-static const struct regmap_range_cfg tasdevice_ranges[] = {
-	{
-		.range_min = 0,
-		.range_max = 256 * 128,
-		.selector_reg = TASDEVICE_PAGE_SELECT,
-		.selector_mask = 0xff,
-		.selector_shift = 0,
-		.window_start = 0,
-		.window_len = 128,
-	},
-};
+static int tasdevice_i2c_send(struct tasdevice_t *tasdev,
+	unsigned char reg, const unsigned char *val, size_t len)
+{
+	struct i2c_client *client = (struct i2c_client *)tasdev->client;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	unsigned char buf[129];
+	int ret;
+
+	if (tas_priv->buses[tasdev->bus].smbus)
+		return i2c_smbus_write_i2c_block_data(client, reg, len, val);
+
+	buf[0] = reg;
+	memcpy(&buf[1], val, len);
+	ret = i2c_master_send(client, buf, len + 1);
+	if (ret < 0)
+		return ret;
+	return (ret == len + 1) ? 0 : -EIO;
+}
 
-static bool tas2781_volatile(struct device *dev, unsigned int reg)
+static int tasdevice_i2c_recv(struct tasdevice_t *tasdev,
+	unsigned int reg, unsigned char *val, size_t len)
 {
-	return true;
+	struct i2c_client *client = (struct i2c_client *)tasdev->client;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	struct i2c_adapter *adap = client->adapter;
+	unsigned char offset = TASDEVICE_PAGE_REG(reg);
+	struct i2c_msg xfer[2];
+	int ret;
+
+	if (tas_priv->buses[tasdev->bus].smbus) {
+		ret = i2c_smbus_read_i2c_block_data(client, offset, len, val);
+		if (ret < 0)
+			return ret;
+		return (ret == len) ? 0 : -EIO;
+	}
+
+	/* No repeated start: set the pointer, then read in a second go */
+	if (adap->quirks && (adap->quirks->flags & I2C_AQ_NO_REP_START)) {
+		ret = i2c_master_send(client, &offset, 1);
+		if (ret < 0)
+			return ret;
+		ret = i2c_master_recv(client, val, len);
+		if (ret < 0)
+			return ret;
+		return (ret == len) ? 0 : -EIO;
+	}
+
+	xfer[0].addr = client->addr;
+	xfer[0].flags = 0;
+	xfer[0].len = 1;
+	xfer[0].buf = &offset;
+	xfer[1].addr = client->addr;
+	xfer[1].flags = I2C_M_RD;
+	xfer[1].len = len;
+	xfer[1].buf = val;
+	ret = i2c_transfer(adap, xfer, 2);
+	if (ret < 0)
+		return ret;
+	return (ret == 2) ? 0 : -EIO;
 }
 
-static const struct regmap_config tasdevice_i2c_regmap = {
-	.reg_bits = 8,
-	.val_bits = 8,
-	.cache_type = REGCACHE_RBTREE,
-	.ranges = tasdevice_ranges,
-	.volatile_reg = tas2781_volatile,
-	.num_ranges = ARRAY_SIZE(tasdevice_ranges),
-	.max_register = 256 * 128,
-};
+/*
+ * Transfer limits of one bus from what its adapter can do. Full I2C
+ * adapters take a whole page per transfer unless their quirks say
+ * otherwise; SMBus-only ones get I2C block transfers of up to 32 bytes
+ * rather than single bytes. tasdevice_bus_write()/_read() split bursts
+ * at these limits as well as at page ends.
+ */
+static int tasdevice_i2c_bus_caps(struct tasdevice_priv *tas_priv,
+	struct tasdevice_bus *bus)
+{
+	struct i2c_adapter *adap = bus->adapter;
+	const struct i2c_adapter_quirks *q = adap->quirks;
+	int ret = 0;
+
+	if (i2c_check_functionality(adap, I2C_FUNC_I2C)) {
+		bus->smbus = false;
+		bus->max_wr = 128;
+		bus->max_rd = 128;
+		bus->readback = !q;
+		if (!q)
+			goto out;
+		if (q->max_write_len)
+			bus->max_wr = min_t(size_t, bus->max_wr,
+				q->max_write_len - 1);
+		if (q->max_read_len)
+			bus->max_rd = min_t(size_t, bus->max_rd,
+				q->max_read_len);
+		if ((q->flags & I2C_AQ_COMB) && q->max_comb_2nd_msg_len)
+			bus->max_rd = min_t(size_t, bus->max_rd,
+				q->max_comb_2nd_msg_len);
+	} else if (i2c_check_functionality(adap, I2C_FUNC_SMBUS_I2C_BLOCK)) {
+		bus->smbus = true;
+		bus->max_wr = I2C_SMBUS_BLOCK_MAX;
+		bus->max_rd = I2C_SMBUS_BLOCK_MAX;
+		bus->readback = false;
+	} else {
+		dev_err(tas_priv->dev, "%s: %s has neither I2C nor SMBus "
+			"block transfers\n", __func__, adap->name);
+		ret = -ENODEV;
+		goto out;
+	}
+	if (!bus->max_wr || !bus->max_rd) {
+		dev_err(tas_priv->dev, "%s: %s transfers are too short\n",
+			__func__, adap->name);
+		ret = -ENODEV;
+		goto out;
+	}
+	dev_info(tas_priv->dev, "%s: %s%s, wr %zu rd %zu bytes\n", __func__,
+		adap->name, bus->smbus ? " (SMBus)" : "", bus->max_wr,
+		bus->max_rd);
+out:
+	return ret;
+}
+
+/*
+ * Write a block and read it back as a single combined transfer: the
+ * write, then a repeated-start register pointer and the read. Used for
+ * checksum verification, where a separate read would cost a whole
+ * second transaction (and give other masters a window in between).
+ * Runs outside regmap, so the caller holds dev_lock and fixes up the
+ * cache afterwards.
+ */
+static int tasdevice_i2c_write_readback(struct tasdevice_t *tasdev,
+	unsigned int reg, const unsigned char *data, unsigned char *rb,
+	unsigned int len)
+{
+	struct i2c_client *client = (struct i2c_client *)tasdev->client;
+	unsigned char page = TASDEVICE_PAGE_ID(reg);
+	unsigned char offset = TASDEVICE_PAGE_REG(reg);
+	unsigned char buf[129];
+	struct i2c_msg xfer[3];
+	int ret = 0;
+
+	if (offset + len > 128)
+		return -EINVAL;
+
+	ret = tasdevice_bus_select(tasdev, TASDEVICE_BOOK_ID(reg), page);
+	if (ret < 0)
+		return ret;
+
+	buf[0] = offset;
+	memcpy(&buf[1], data, len);
+	xfer[0].addr = client->addr;
+	xfer[0].flags = 0;
+	xfer[0].len = len + 1;
+	xfer[0].buf = buf;
+	xfer[1].addr = client->addr;
+	xfer[1].flags = 0;
+	xfer[1].len = 1;
+	xfer[1].buf = &offset;
+	xfer[2].addr = client->addr;
+	xfer[2].flags = I2C_M_RD;
+	xfer[2].len = len;
+	xfer[2].buf = rb;
+	ret = i2c_transfer(client->adapter, xfer, 3);
+	if (ret < 0)
+		return ret;
+	if (ret != 3)
+		return -EIO;
+	tasdevice_bus_track(tasdev, page, offset, data, len);
+	return 0;
+}
 
 static void tas2781_set_global_mode(struct tasdevice_priv *tas_dev)
 {
@@ -87,12 +226,118 @@ static void tas2563_set_global_mode(struct tasdevice_priv *tas_dev)
 	}
 }
 
+/*
+ * One client and one regmap per chip, plus one more for the broadcast
+ * address, so no channel switch ever has to touch client->addr or drop
+ * another chip's selector state.
+ */
+static int tasdevice_i2c_init_regmaps(struct tasdevice_priv *tas_priv,
+	struct i2c_client *i2c)
+{
+	struct tasdevice_t *tasdev;
+	struct i2c_client *client;
+	struct i2c_adapter *adap;
+	int i, ret = 0;
+
+	tas_priv->bus_send = tasdevice_i2c_send;
+	tas_priv->bus_recv = tasdevice_i2c_recv;
+	for (i = 0; i < tas_priv->nbus; i++) {
+		ret = tasdevice_i2c_bus_caps(tas_priv, &tas_priv->buses[i]);
+		if (ret < 0)
+			goto out;
+	}
+
+	tas_priv->tasdevice[tas_priv->ndev].mnDevAddr =
+		tas_priv->glb_addr.dev_addr;
+
+	for (i = 0; i <= tas_priv->ndev; i++) {
+		tasdev = &tas_priv->tasdevice[i];
+		if (i == tas_priv->ndev && !tasdev->mnDevAddr)
+			break;
+
+		adap = tas_priv->buses[tasdev->bus].adapter;
+		if (tasdev->mnDevAddr == i2c->addr && adap == i2c->adapter)
+			client = i2c;
+		else
+			client = devm_i2c_new_dummy_device(&i2c->dev, adap,
+				tasdev->mnDevAddr);
+		if (IS_ERR(client)) {
+			ret = PTR_ERR(client);
+			dev_err(tas_priv->dev, "%s: addr 0x%02x, E=%d\n",
+				__func__, tasdev->mnDevAddr, ret);
+			goto out;
+		}
+
+		tasdev->client = (void *)client;
+		ret = tasdevice_regmap_init(tas_priv, tasdev);
+		if (ret < 0)
+			goto out;
+	}
+	tas_priv->regmap = tas_priv->tasdevice[0].regmap;
+out:
+	return ret;
+}
+
+static void tasdevice_i2c_put_adapter(void *adap)
+{
+	i2c_put_adapter(adap);
+}
+
+/*
+ * Amps may hang off more than one adapter: "ti,i2c-buses" then holds
+ * one adapter phandle per "reg" entry. Without it, or for a missing
+ * entry, an amp sits on the adapter the driver was probed on. Every
+ * distinct adapter becomes a bus of its own.
+ */
+static int tasdevice_i2c_parse_buses(struct tasdevice_priv *tas_priv,
+	struct device_node *np, int ndev)
+{
+	struct i2c_client *client = (struct i2c_client *)tas_priv->client;
+	struct device_node *adap_np;
+	struct i2c_adapter *adap;
+	int i, b, ret = 0;
+
+	tas_priv->buses[0].adapter = client->adapter;
+	tas_priv->nbus = 1;
+
+	for (i = 0; i < ndev; i++) {
+		adap_np = of_parse_phandle(np, "ti,i2c-buses", i);
+		if (!adap_np)
+			continue;
+		adap = of_get_i2c_adapter_by_node(adap_np);
+		of_node_put(adap_np);
+		if (!adap) {
+			ret = -EPROBE_DEFER;
+			goto out;
+		}
+		for (b = 0; b < tas_priv->nbus; b++)
+			if (tas_priv->buses[b].adapter == adap)
+				break;
+		if (b < tas_priv->nbus) {
+			i2c_put_adapter(adap);
+		} else {
+			ret = devm_add_action_or_reset(tas_priv->dev,
+				tasdevice_i2c_put_adapter, adap);
+			if (ret < 0)
+				goto out;
+			tas_priv->buses[b].adapter = adap;
+			tas_priv->nbus++;
+		}
+		tas_priv->tasdevice[i].bus = b;
+	}
+	if (tas_priv->nbus > 1)
+		dev_info(tas_priv->dev, "%s: %d amps on %u buses\n",
+			__func__, ndev, tas_priv->nbus);
+out:
+	return ret;
+}
+
 static int tasdevice_i2c_parse_dt(struct tasdevice_priv *tas_priv)
 {
 	struct i2c_client *client = (struct i2c_client *)tas_priv->client;
 	struct device_node *np = tas_priv->dev->of_node;
 	unsigned int dev_addrs[TASDEVICE_MAX_CHANNELS];
-	int i, ndev;
+	int i, ndev, ret;
 #ifdef CONFIG_OF
 	int len, sw, aw;
 	const __be32 *reg, *reg_end;
@@ -135,7 +380,13 @@ static int tasdevice_i2c_parse_dt(struct tasdevice_priv *tas_priv)
 	for (i = 0; i < ndev; i++)
 		tas_priv->tasdevice[i].mnDevAddr = dev_addrs[i];
 
-	if (of_property_read_bool(np, "ti,global-addr-enable"))
+	ret = tasdevice_i2c_parse_buses(tas_priv, np, tas_priv->ndev);
+	if (ret < 0)
+		return ret;
+
+	/* A broadcast only reaches the amps on one adapter */
+	if (of_property_read_bool(np, "ti,global-addr-enable") &&
+		tas_priv->nbus == 1)
 		/* Enable I2C broadcast */
 		tas_priv->glb_addr.dev_addr = TASDEVICE_GLOBAL_ADDR;
 	else
@@ -159,7 +410,9 @@ static int tasdevice_i2c_probe(struct i2c_client *i2c,
 	struct tasdevice_priv *tas_dev = NULL;
 	int ret = 0;
 
-	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C)) {
+	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C) &&
+		!i2c_check_functionality(i2c->adapter,
+			I2C_FUNC_SMBUS_I2C_BLOCK)) {
 		dev_err(&i2c->dev,
 			"%s: I2C check failed\n", __func__);
 		ret = -ENODEV;
@@ -183,15 +436,13 @@ static int tasdevice_i2c_probe(struct i2c_client *i2c,
 		dev_err(tas_dev->dev, "No DTS info\n");
 		goto out;
 	}
+	if (ret < 0)
+		goto out;
 
-	tas_dev->regmap = devm_regmap_init_i2c(i2c,
-		&tasdevice_i2c_regmap);
-	if (IS_ERR(tas_dev->regmap)) {
-		ret = PTR_ERR(tas_dev->regmap);
-		dev_err(&i2c->dev, "Failed to allocate register map: %d\n",
-			ret);
-		return ret;
-	}
+	ret = tasdevice_i2c_init_regmaps(tas_dev, i2c);
+	if (ret < 0)
+		goto out;
+	tas_dev->write_readback = tasdevice_i2c_write_readback;
 
 	if (tas_dev->glb_addr.dev_addr != 0
 		&& tas_dev->glb_addr.dev_addr < 0x7F) {
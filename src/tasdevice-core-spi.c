@@ -24,24 +24,195 @@
 #include <linux/regmap.h>
 #include <linux/slab.h>
 #include <linux/spi/spi.h>
+#include <linux/version.h>
 
 #include "tasdevice.h"
 #include "tasdevice-rw.h"
 #include "tasdevice-node.h"
+#include "tasdevice-regmap.h"
 
-const struct regmap_config tasdevice_spi_regmap = {
-	.reg_bits = 7,
-	.val_bits = 8,
-	.cache_type = REGCACHE_NONE,
-	.max_register = 1 * 128,
-	.read_flag_mask = 0x1,
-	.pad_bits = 1,
-};
+#if KERNEL_VERSION(6, 3, 0) <= LINUX_VERSION_CODE
+#define TASDEVICE_SPI_CS(spi)	spi_get_chipselect(spi, 0)
+#else
+#define TASDEVICE_SPI_CS(spi)	((spi)->chip_select)
+#endif
+
+/* Command byte, data and the dummy byte some reads start with */
+#define TASDEVICE_SPI_BUF_SIZE	(128 + 2)
+
+/*
+ * The first byte carries the register offset in bits 7:1 and the read
+ * flag in bit 0. Buffers are the per-chip kmalloc ones, so the
+ * controller can DMA straight from and into them.
+ */
+static int tasdevice_spi_send(struct tasdevice_t *tasdev,
+	unsigned char reg, const unsigned char *val, size_t len)
+{
+	struct spi_device *spi = (struct spi_device *)tasdev->client;
+
+	tasdev->tx_buf[0] = reg << 1;
+	memcpy(&tasdev->tx_buf[1], val, len);
+	return spi_write(spi, tasdev->tx_buf, len + 1);
+}
+
+/*
+ * Outside book 0, or beyond page 1 of book 0, the chip clocks out one
+ * dummy byte ahead of the data.
+ */
+static int tasdevice_spi_recv(struct tasdevice_t *tasdev,
+	unsigned int reg, unsigned char *val, size_t len)
+{
+	struct spi_device *spi = (struct spi_device *)tasdev->client;
+	size_t dummy = (TASDEVICE_BOOK_ID(reg) > 0 ||
+		TASDEVICE_PAGE_ID(reg) > 1) ? 1 : 0;
+	struct spi_transfer xfer[2] = {
+		{
+			.tx_buf = tasdev->tx_buf,
+			.len = 1,
+		}, {
+			.rx_buf = tasdev->rx_buf,
+			.len = len + dummy,
+		},
+	};
+	int ret;
+
+	tasdev->tx_buf[0] = (TASDEVICE_PAGE_REG(reg) << 1) | 0x1;
+	ret = spi_sync_transfer(spi, xfer, ARRAY_SIZE(xfer));
+	if (ret < 0)
+		return ret;
+	memcpy(val, &tasdev->rx_buf[dummy], len);
+	return 0;
+}
+
+static void tasdevice_spi_unregister(void *data)
+{
+	spi_unregister_device((struct spi_device *)data);
+}
+
+/* A spi_device of its own for every further amp on the controller */
+static struct spi_device *tasdevice_spi_new_dev(struct spi_device *spi,
+	unsigned int cs)
+{
+	struct spi_device *anc;
+	int ret = 0;
+#if KERNEL_VERSION(6, 0, 0) <= LINUX_VERSION_CODE
+
+	anc = spi_new_ancillary_device(spi, cs);
+	if (IS_ERR(anc))
+		return anc;
+#else
+	struct spi_board_info info = {
+		.modalias = "tasdev-ancillary",
+		.max_speed_hz = spi->max_speed_hz,
+		.chip_select = cs,
+		.mode = spi->mode,
+	};
+
+	anc = spi_new_device(spi->controller, &info);
+	if (!anc)
+		return ERR_PTR(-ENODEV);
+#endif
+	ret = devm_add_action_or_reset(&spi->dev, tasdevice_spi_unregister,
+		anc);
+	if (ret)
+		return ERR_PTR(ret);
+
+	anc->mode = spi->mode;
+	anc->bits_per_word = spi->bits_per_word;
+	ret = spi_setup(anc);
+	if (ret)
+		return ERR_PTR(ret);
+	return anc;
+}
+
+/*
+ * One spi_device and one regmap per amp, with the same book/page
+ * handling as I2C, so switching amps never rewrites chip_select of a
+ * live device. SPI has no broadcast, tasdevice[ndev] stays unused.
+ */
+static int tasdevice_spi_init_regmaps(struct tasdevice_priv *tas_priv,
+	struct spi_device *spi)
+{
+	struct tasdevice_t *tasdev;
+	struct spi_device *client;
+	int i, ret = 0;
+
+	tas_priv->bus_send = tasdevice_spi_send;
+	tas_priv->bus_recv = tasdevice_spi_recv;
+	tas_priv->buses[0].max_wr = min_t(size_t, 128,
+		spi_max_transfer_size(spi) - 2);
+	tas_priv->buses[0].max_rd = tas_priv->buses[0].max_wr;
+
+	for (i = 0; i < tas_priv->ndev; i++) {
+		tasdev = &tas_priv->tasdevice[i];
+		if (tasdev->mnDevAddr == TASDEVICE_SPI_CS(spi))
+			client = spi;
+		else
+			client = tasdevice_spi_new_dev(spi, tasdev->mnDevAddr);
+		if (IS_ERR(client)) {
+			ret = PTR_ERR(client);
+			dev_err(tas_priv->dev, "%s: cs %u, E=%d\n",
+				__func__, tasdev->mnDevAddr, ret);
+			goto out;
+		}
+
+		tasdev->tx_buf = devm_kmalloc(tas_priv->dev,
+			TASDEVICE_SPI_BUF_SIZE, GFP_KERNEL);
+		tasdev->rx_buf = devm_kmalloc(tas_priv->dev,
+			TASDEVICE_SPI_BUF_SIZE, GFP_KERNEL);
+		if (!tasdev->tx_buf || !tasdev->rx_buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		tasdev->client = (void *)client;
+		ret = tasdevice_regmap_init(tas_priv, tasdev);
+		if (ret < 0)
+			goto out;
+	}
+	tas_priv->regmap = tas_priv->tasdevice[0].regmap;
+out:
+	return ret;
+}
+
+/* reg lists the chip select of every amp, as it lists addresses on I2C */
+static int tasdevice_spi_parse_dt(struct tasdevice_priv *tas_priv)
+{
+	struct spi_device *spi = (struct spi_device *)tas_priv->client;
+	struct device_node *np = tas_priv->dev->of_node;
+	unsigned int cs[TASDEVICE_MAX_CHANNELS];
+	int i, ndev;
+
+	strcpy(tas_priv->dev_name, tasdevice_id[tas_priv->chip_id].name);
+
+	ndev = of_property_read_variable_u32_array(np, "reg", cs, 1,
+		TASDEVICE_MAX_CHANNELS);
+	if (ndev <= 0) {
+		ndev = 1;
+		cs[0] = TASDEVICE_SPI_CS(spi);
+	}
+
+	if (ndev > TAS2563_MAX_DEVICE && TAS2563 == tas_priv->chip_id) {
+		dev_info(tas_priv->dev, "Do not support more than 4 TAS2563s "
+			"on the same SPI bus, force the device number from %d "
+			"to %d ", ndev, TAS2563_MAX_DEVICE);
+		ndev = TAS2563_MAX_DEVICE;
+	}
+
+	tas_priv->ndev = ndev;
+	for (i = 0; i < ndev; i++)
+		tas_priv->tasdevice[i].mnDevAddr = cs[i];
+	tas_priv->glb_addr.dev_addr = 0;
+
+	tasdevice_parse_dt_reset_irq_pin(tas_priv, np);
+
+	return 0;
+}
 
 static int tasdevice_spi_probe(struct spi_device *spi)
 {
 	struct tasdevice_priv *tas_dev = NULL;
-	int ret = 0, i = 0;
+	int ret = 0;
 	const struct spi_device_id *id = spi_get_device_id(spi);
 
 	dev_info(&spi->dev, "%s, spi_device_id:%s", __func__, id->name);
@@ -58,22 +229,24 @@ static int tasdevice_spi_probe(struct spi_device *spi)
 	tas_dev->chip_id = id->driver_data;
 
 	if (spi->dev.of_node)
-		ret = tasdevice_parse_dt(tas_dev);
+		ret = tasdevice_spi_parse_dt(tas_dev);
 	else {
 		dev_err(tas_dev->dev, "No DTS info\n");
 		goto out;
 	}
 	spi->mode = SPI_MODE_1;
 	spi->bits_per_word = 8;
-	tas_dev->regmap = devm_regmap_init_spi(spi,
-		&tasdevice_spi_regmap);
-	if (IS_ERR(tas_dev->regmap)) {
-		ret = PTR_ERR(tas_dev->regmap);
-		dev_err(&spi->dev, "Failed to allocate register map: %d\n",
+	ret = spi_setup(spi);
+	if (ret) {
+		dev_err(&spi->dev, "%s: spi_setup failed %d\n", __func__,
 			ret);
-		return ret;
+		goto out;
 	}
 
+	ret = tasdevice_spi_init_regmaps(tas_dev, spi);
+	if (ret < 0)
+		goto out;
+
 	ret = tasdevice_probe_next(tas_dev);
 
 out:
@@ -38,6 +38,7 @@
 #include "tasdevice-node.h"
 #include "tasdevice-codec.h"
 #include "tasdevice-dsp.h"
+#include "tasdevice-debugfs.h"
 #include "tasdevice-misc.h"
 
 #define TASDEVICE_IRQ_DET_TIMEOUT		(30000)
@@ -103,6 +104,14 @@ static DEVICE_ATTR(devinfo, 0664, devinfo_show, NULL);
 static DEVICE_ATTR(dspfw_config, 0664, dspfw_config_show, NULL);
 static DEVICE_ATTR(force_fw_load_chip, 0664, force_fw_load_chip_show,
 	force_fw_load_chip_store);
+static DEVICE_ATTR(saved_xfers, 0664, saved_xfers_show,
+	saved_xfers_store);
+static DEVICE_ATTR(shadow_stats, 0664, shadow_stats_show,
+	shadow_stats_store);
+static DEVICE_ATTR(force_full_write, 0664, force_full_write_show,
+	force_full_write_store);
+static DEVICE_ATTR(bus_stats, 0664, bus_stats_show, bus_stats_store);
+static DEVICE_ATTR_WO(regbin_reload);
 
 static struct attribute *sysfs_attrs[] = {
 	&dev_attr_reg.attr,
@@ -114,6 +123,11 @@ static struct attribute *sysfs_attrs[] = {
 	&dev_attr_devinfo.attr,
 	&dev_attr_dspfw_config.attr,
 	&dev_attr_force_fw_load_chip.attr,
+	&dev_attr_saved_xfers.attr,
+	&dev_attr_shadow_stats.attr,
+	&dev_attr_force_full_write.attr,
+	&dev_attr_bus_stats.attr,
+	&dev_attr_regbin_reload.attr,
 	NULL
 };
 //nodes are in /sys/devices/platform/XXXXXXXX.i2cX/i2c-X/
@@ -224,9 +238,17 @@ static void tasdevice_reset(struct tasdevice_priv *tas_dev)
 	int ret, i;
 
 	if (tas_dev->reset) {
+		tasdevice_ctl_hold(tas_dev);
 		gpiod_set_value_cansleep(tas_dev->reset, 0);
 		usleep_range(500, 1000);
 		gpiod_set_value_cansleep(tas_dev->reset, 1);
+		/* Every chip comes back on book 0, page 0 */
+		for (i = 0; i <= tas_dev->ndev; i++) {
+			tas_dev->tasdevice[i].cur_book = 0;
+			tas_dev->tasdevice[i].cur_page = 0;
+		}
+		tasdevice_regcache_drop(tas_dev, tas_dev->ndev);
+		tasdevice_ctl_release(tas_dev);
 	} else {
 		for (i = 0; i < tas_dev->ndev; i++) {
 			ret = tasdevice_dev_write(tas_dev, i,
@@ -243,18 +265,27 @@ int tasdevice_probe_next(struct tasdevice_priv *tas_dev)
 {
 	int nResult, i;
 
-	for (i = 0; i < tas_dev->ndev; i++) {
+	for (i = 0; i <= tas_dev->ndev; i++) {
 		tas_dev->tasdevice[i].cur_book = -1;
+		tas_dev->tasdevice[i].cur_page = -1;
 		tas_dev->tasdevice[i].mnCurrentProgram = -1;
 		tas_dev->tasdevice[i].mnCurrentConfiguration = -1;
+		tas_dev->tasdevice[i].mnAppliedRegConf = -1;
 	}
 	mutex_init(&tas_dev->dev_lock);
+	tasdevice_bus_setup(tas_dev);
 	mutex_init(&tas_dev->file_lock);
+	mutex_init(&tas_dev->mtRegbin.parse_lock);
+	init_completion(&tas_dev->regbin_reload_done);
+	complete_all(&tas_dev->regbin_reload_done);
+	atomic_set(&tas_dev->prio_waiters, 0);
+	init_waitqueue_head(&tas_dev->prio_wq);
 	tas_dev->hwreset = tasdevice_reset;
 	tas_dev->read = tasdevice_dev_read;
 	tas_dev->write = tasdevice_dev_write;
 	tas_dev->bulk_read = tasdevice_dev_bulk_read;
 	tas_dev->bulk_write = tasdevice_dev_bulk_write;
+	tas_dev->multi_write = tasdevice_dev_multi_write;
 	tas_dev->update_bits = tasdevice_dev_update_bits;
 	tas_dev->set_calibration = tas2781_set_calibration;
 
@@ -271,9 +302,12 @@ int tasdevice_probe_next(struct tasdevice_priv *tas_dev)
 		dev_err(tas_dev->dev, "Sysfs registration failed\n");
 		goto out;
 	}
+	tasdevice_debugfs_init(tas_dev);
 
 	INIT_DELAYED_WORK(&tas_dev->powercontrol_work,
 		powercontrol_routine);
+	spin_lock_init(&tas_dev->ctl_lock);
+	INIT_WORK(&tas_dev->ctl_work, tasdevice_ctl_work);
 
 	mutex_init(&tas_dev->codec_lock);
 	nResult = tasdevice_register_codec(tas_dev);
@@ -293,9 +327,12 @@ void tasdevice_remove(struct tasdevice_priv *tas_dev)
 		cancel_delayed_work(&tas_dev->irq_info.irq_work);
 	}
 	cancel_delayed_work_sync(&tas_dev->irq_info.irq_work);
+	cancel_work_sync(&tas_dev->ctl_work);
+	tasdevice_debugfs_remove(tas_dev);
 
 	mutex_destroy(&tas_dev->dev_lock);
 	mutex_destroy(&tas_dev->file_lock);
+	mutex_destroy(&tas_dev->mtRegbin.parse_lock);
 	mutex_destroy(&tas_dev->codec_lock);
 	misc_deregister(&tas_dev->misc_dev);
 	sysfs_remove_group(&tas_dev->dev->kobj, &tasdevice_attribute_group);
@@ -311,6 +348,8 @@ static int tasdevice_pm_suspend(struct device *dev)
 		return -EINVAL;
 	}
 
+	/* Let the last volume change reach the amps first */
+	flush_work(&tas_dev->ctl_work);
 	mutex_lock(&tas_dev->codec_lock);
 
 	tas_dev->mb_runtime_suspend = true;
@@ -328,6 +367,7 @@ static int tasdevice_pm_suspend(struct device *dev)
 static int tasdevice_pm_resume(struct device *dev)
 {
 	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int i;
 
 	if (!tas_dev) {
 		dev_err(tas_dev->dev, "%s: drvdata is NULL\n",
@@ -335,9 +375,20 @@ static int tasdevice_pm_resume(struct device *dev)
 		return -EINVAL;
 	}
 
+	tasdevice_ctl_hold(tas_dev);
 	mutex_lock(&tas_dev->codec_lock);
 	tas_dev->mb_runtime_suspend = false;
+	/*
+	 * The supply may have been cut while suspended: nothing cached about
+	 * the chips can be trusted, the next stream start writes it all.
+	 */
+	for (i = 0; i <= tas_dev->ndev; i++) {
+		tas_dev->tasdevice[i].cur_book = -1;
+		tas_dev->tasdevice[i].cur_page = -1;
+	}
+	tasdevice_regcache_drop(tas_dev, tas_dev->ndev);
 	mutex_unlock(&tas_dev->codec_lock);
+	tasdevice_ctl_release(tas_dev);
 	return 0;
 }
 
@@ -0,0 +1,139 @@
+/*
+ * TAS2563/TAS2871 Linux Driver
+ *
+ * Copyright (C) 2022 - 2024 Texas Instruments Incorporated
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/regmap.h>
+#include <linux/seq_file.h>
+
+#include "tasdevice.h"
+#include "tasdevice-debugfs.h"
+#include "tasdevice-rw.h"
+
+/*
+ * debugfs layout, one directory per driver instance:
+ *   tasdevice-<dev>/chn<N>/stats	counters of amp N
+ *   tasdevice-<dev>/chn<N>/latency	log2 histograms of amp N
+ *   tasdevice-<dev>/glb/...		same for the broadcast address
+ *   tasdevice-<dev>/reset		write anything to clear all of them
+ */
+
+static int tasdevice_stats_show(struct seq_file *s, void *unused)
+{
+	struct tasdevice_t *tasdev = s->private;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	struct tasdevice_bus_stats *stats = &tasdev->bus_stats;
+	struct mutex *lock = tasdevice_chn_lock(tas_priv,
+		tasdev - tas_priv->tasdevice);
+
+	mutex_lock(lock);
+	seq_printf(s, "addr:\t\t0x%02x\n", tasdev->mnDevAddr);
+	seq_printf(s, "xfers:\t\t%lu\n", stats->xfers);
+	seq_printf(s, "bytes_wr:\t%lu\n", stats->bytes_wr);
+	seq_printf(s, "bytes_rd:\t%lu\n", stats->bytes_rd);
+	seq_printf(s, "book_switches:\t%lu\n", stats->book_switches);
+	seq_printf(s, "page_switches:\t%lu\n", stats->page_switches);
+	seq_printf(s, "retries:\t%lu\n", stats->retries);
+	seq_printf(s, "failures:\t%lu\n", stats->failures);
+	seq_printf(s, "breaker_trips:\t%lu\n", stats->breaker_trips);
+	seq_printf(s, "fast_fails:\t%lu\n", stats->fast_fails);
+	seq_printf(s, "yields:\t\t%lu\n", stats->yields);
+	seq_printf(s, "readback_merged:\t%lu\n", stats->readback_merged);
+	mutex_unlock(lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tasdevice_stats);
+
+static int tasdevice_latency_show(struct seq_file *s, void *unused)
+{
+	struct tasdevice_t *tasdev = s->private;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	struct tasdevice_bus_stats *stats = &tasdev->bus_stats;
+	struct mutex *lock = tasdevice_chn_lock(tas_priv,
+		tasdev - tas_priv->tasdevice);
+	int i;
+
+	mutex_lock(lock);
+	seq_puts(s, "us\t\tsingle\t\tbulk\n");
+	for (i = 0; i < TASDEVICE_LAT_BUCKETS; i++) {
+		if (i == 0)
+			seq_puts(s, "<1\t");
+		else if (i == TASDEVICE_LAT_BUCKETS - 1)
+			seq_printf(s, ">=%lu\t", 1UL << (i - 1));
+		else
+			seq_printf(s, "%lu-%lu\t", 1UL << (i - 1),
+				(1UL << i) - 1);
+		seq_printf(s, "\t%lu\t\t%lu\n", stats->lat_single[i],
+			stats->lat_bulk[i]);
+	}
+	mutex_unlock(lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tasdevice_latency);
+
+/* The breakers are left alone, bus_stats in sysfs resets those */
+static ssize_t tasdevice_reset_write(struct file *file,
+	const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	struct tasdevice_priv *tas_priv = file->private_data;
+	struct tasdevice_bus_stats *stats;
+	int i;
+
+	for (i = 0; i <= tas_priv->ndev; i++) {
+		stats = &tas_priv->tasdevice[i].bus_stats;
+		mutex_lock(tasdevice_chn_lock(tas_priv, i));
+		memset(stats, 0, sizeof(*stats));
+		mutex_unlock(tasdevice_chn_lock(tas_priv, i));
+	}
+	return count;
+}
+
+static const struct file_operations tasdevice_reset_fops = {
+	.open = simple_open,
+	.write = tasdevice_reset_write,
+	.llseek = default_llseek,
+};
+
+void tasdevice_debugfs_init(struct tasdevice_priv *tas_priv)
+{
+	struct dentry *dir;
+	char name[32];
+	int i;
+
+	scnprintf(name, sizeof(name), "tasdevice-%s", dev_name(tas_priv->dev));
+	tas_priv->debugfs_dir = debugfs_create_dir(name, NULL);
+
+	for (i = 0; i <= tas_priv->ndev; i++) {
+		if (!tas_priv->tasdevice[i].regmap)
+			continue;
+		if (i == tas_priv->ndev)
+			scnprintf(name, sizeof(name), "glb");
+		else
+			scnprintf(name, sizeof(name), "chn%d", i);
+		dir = debugfs_create_dir(name, tas_priv->debugfs_dir);
+		debugfs_create_file("stats", 0444, dir,
+			&tas_priv->tasdevice[i], &tasdevice_stats_fops);
+		debugfs_create_file("latency", 0444, dir,
+			&tas_priv->tasdevice[i], &tasdevice_latency_fops);
+	}
+	debugfs_create_file("reset", 0200, tas_priv->debugfs_dir, tas_priv,
+		&tasdevice_reset_fops);
+}
+
+void tasdevice_debugfs_remove(struct tasdevice_priv *tas_priv)
+{
+	debugfs_remove_recursive(tas_priv->debugfs_dir);
+	tas_priv->debugfs_dir = NULL;
+}
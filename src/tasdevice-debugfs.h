@@ -0,0 +1,21 @@
+/*
+ * TAS2563/TAS2871 Linux Driver
+ *
+ * Copyright (C) 2022 - 2024 Texas Instruments Incorporated
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __TASDEVICE_DEBUGFS_H__
+#define __TASDEVICE_DEBUGFS_H__
+
+void tasdevice_debugfs_init(struct tasdevice_priv *tas_priv);
+void tasdevice_debugfs_remove(struct tasdevice_priv *tas_priv);
+#endif
@@ -34,6 +34,8 @@
 #include "tasdevice.h"
 #include "tasdevice-dsp_git.h"
 #include "tasdevice-dsp_kernel.h"
+#include "tasdevice-rw.h"
+#include "tasdevice-trace.h"
 
 #define TAS2781_CAL_BIN_PATH			"/lib/firmware/"
 
@@ -828,13 +830,18 @@ static int isYRAM(struct tasdevice_priv *pTAS2781, struct TYCRC *pCRCData,
 	return nResult;
 }
 
+/*
+ * The checksum helpers also do the write: YRAM registers go out through
+ * tasdevice_dev_verified_write() so the write and its readback share
+ * one transaction, everything else is a plain write.
+ */
 static int doSingleRegCheckSum(struct tasdevice_priv *tas_priv,
 	unsigned short chl, unsigned char nBook, unsigned char nPage,
 	unsigned char nReg, unsigned char nValue)
 {
 	int nResult = 0;
 	struct TYCRC sCRCData;
-	unsigned int nData1 = 0;
+	unsigned char nData1 = 0;
 
 	if ((nBook == TASDEVICE_BOOK_ID(TAS2781_SA_COEFF_SWAP_REG))
 		&& (nPage == TASDEVICE_PAGE_ID(TAS2781_SA_COEFF_SWAP_REG))
@@ -843,13 +850,14 @@ static int doSingleRegCheckSum(struct tasdevice_priv *tas_priv,
 		TAS2781_SA_COEFF_SWAP_REG) + 4))) {
 		/*DSP swap command, pass */
 		nResult = 0;
-		goto end;
+		goto write;
 	}
 
 	nResult = isYRAM(tas_priv, &sCRCData, nBook, nPage, nReg, 1);
 	if (nResult == 1) {
-		nResult = tas_priv->read(tas_priv, chl,
-				TASDEVICE_REG(nBook, nPage, nReg), &nData1);
+		nResult = tasdevice_dev_verified_write(tas_priv, chl,
+				TASDEVICE_REG(nBook, nPage, nReg), &nValue,
+				&nData1, 1);
 		if (nResult < 0)
 			goto end;
 
@@ -863,26 +871,21 @@ static int doSingleRegCheckSum(struct tasdevice_priv *tas_priv,
 			goto end;
 		}
 
-		if (nData1 != nValue) {
-			dev_err(tas_priv->dev, "error2, B[0x%x]P[0x%x]R[0x%x] "
-				"W[0x%x], R[0x%x]\n", nBook, nPage, nReg,
-				nValue, nData1);
-			nResult = -EAGAIN;
-			goto end;
-		}
-
 		nResult = crc8(tas_priv->crc8_lkp_tbl, &nValue, 1, 0);
+		goto end;
 	}
-
+write:
+	nResult = tas_priv->write(tas_priv, chl,
+		TASDEVICE_REG(nBook, nPage, nReg), nValue);
 end:
 	return nResult;
 }
 
 static int doMultiRegCheckSum(struct tasdevice_priv *tas_priv,
 	unsigned short chn, unsigned char nBook, unsigned char nPage,
-	unsigned char nReg, unsigned int len)
+	unsigned char nReg, unsigned char *pData, unsigned int len)
 {
-	int nResult = 0, i = 0;
+	int nResult = 0, i = 0, j = 0;
 	unsigned char nCRCChkSum = 0;
 	unsigned char nBuf1[128] = {0};
 	struct TYCRC TCRCData;
@@ -899,26 +902,23 @@ static int doMultiRegCheckSum(struct tasdevice_priv *tas_priv,
 		&& (len == 4)) {
 		/*DSP swap command, pass */
 		nResult = 0;
-		goto end;
+		goto write;
 	}
 
 	nResult = isYRAM(tas_priv, &TCRCData, nBook, nPage, nReg, len);
-	dev_info(tas_priv->dev,
-		"isYRAM: nBook 0x%x, nPage 0x%x, nReg 0x%x\n",
-		nBook, nPage, nReg);
-	dev_info(tas_priv->dev,
-		"isYRAM: TCRCData.mnLen 0x%x, len 0x%x, nResult %d\n",
-		TCRCData.mnLen, len, nResult);
-	dev_info(tas_priv->dev, "TCRCData.mnOffset %x\n", TCRCData.mnOffset);
+	dev_dbg(tas_priv->dev,
+		"isYRAM: B0x%x P0x%x R0x%x len 0x%x, crc len 0x%x off 0x%x, %d\n",
+		nBook, nPage, nReg, len, TCRCData.mnLen, TCRCData.mnOffset,
+		nResult);
 	if (nResult == 1) {
 		if (len == 1) {
 			dev_err(tas_priv->dev, "firmware error\n");
 			nResult = -EINVAL;
 			goto end;
 		} else {
-			nResult = tas_priv->bulk_read(tas_priv, chn,
-				TASDEVICE_REG(nBook, nPage, TCRCData.mnOffset),
-				nBuf1, TCRCData.mnLen);
+			nResult = tasdevice_dev_verified_write(tas_priv, chn,
+				TASDEVICE_REG(nBook, nPage, nReg), pData,
+				nBuf1, len);
 			if (nResult < 0)
 				goto end;
 
@@ -936,16 +936,30 @@ static int doMultiRegCheckSum(struct tasdevice_priv *tas_priv,
 						+ 4))) {
 					/*DSP swap command, bypass */
 					continue;
-				} else
-					nCRCChkSum  +=
-					crc8(tas_priv->crc8_lkp_tbl, &nBuf1[i],
-						1, 0);
+				}
+				j = i + TCRCData.mnOffset - nReg;
+				if (nBuf1[j] != pData[j]) {
+					dev_err(tas_priv->dev, "error2, "
+						"B[0x%x]P[0x%x]R[0x%x] "
+						"W[0x%x], R[0x%x]\n", nBook,
+						nPage, nReg + j, pData[j],
+						nBuf1[j]);
+					nResult = -EAGAIN;
+					tas_priv->tasdevice[chn].mnErrCode |=
+						ERROR_YRAM_CRCCHK;
+					goto end;
+				}
+				nCRCChkSum  += crc8(tas_priv->crc8_lkp_tbl,
+					&nBuf1[j], 1, 0);
 			}
 
 			nResult = nCRCChkSum;
 		}
+		goto end;
 	}
-
+write:
+	nResult = tas_priv->bulk_write(tas_priv, chn,
+		TASDEVICE_REG(nBook, nPage, nReg), pData, len);
 end:
 	return nResult;
 }
@@ -965,7 +979,10 @@ static int tasdevice_load_block(struct tasdevice_priv *tas_dev,
 	unsigned int nValue = 0;
 	int nRetry = 6;
 	unsigned char *pData = block->mpData;
+	struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+	int nSeq = 0;
 	int chn = 0, chnend = 0;
+	bool bSession = false;
 
 	dev_info(tas_dev->dev,
 		"TAS2781 load block: Type = %d, commands = %d\n",
@@ -1007,14 +1024,24 @@ static int tasdevice_load_block(struct tasdevice_priv *tas_dev,
 	}
 
 	for (; chn < chnend; chn++) {
-		if (tas_dev->tasdevice[chn].bLoading == false)
+		if (tas_dev->tasdevice[chn].bLoading == false ||
+			!tasdevice_chn_mine(tas_dev, chn))
 			continue;
+		/* Hold the bus for the whole block on this channel, control
+		 * writes still get in between commands.
+		 */
+		nResult = tasdevice_session_begin_preempt(tas_dev, chn);
+		if (nResult < 0)
+			goto end;
+		bSession = true;
 start:
 		if (block->mbPChkSumPresent) {
 			nResult = tas_dev->write(tas_dev, chn,
 				TASDEVICE_I2CChecksum, 0);
 			if (nResult < 0)
 				goto end;
+			/* The chip sums what it receives, send every byte */
+			tas_dev->tasdevice[chn].bNoShadow = true;
 		}
 
 		if (block->mbYChkSumPresent)
@@ -1032,46 +1059,72 @@ start:
 
 			nCommand++;
 
-			if (nOffset <= 0x7F) {
-				nResult = tas_dev->write(tas_dev, chn,
-					TASDEVICE_REG(nBook, nPage, nOffset),
-					nData);
+			if (nOffset <= 0x7F && !block->mbYChkSumPresent) {
+				/* No per-register readback, so send the run of
+				 * consecutive single writes as one sequence.
+				 */
+				nSeq = 0;
+				seq[nSeq].reg = TASDEVICE_REG(nBook, nPage,
+					nOffset);
+				seq[nSeq].def = nData;
+				seq[nSeq++].delay_us = 0;
+				while (nCommand < block->mnCommands &&
+					nSeq < TASDEVICE_SEQ_CHUNK) {
+					pData = block->mpData + nCommand * 4;
+					if (pData[2] > 0x7F)
+						break;
+					seq[nSeq].reg = TASDEVICE_REG(pData[0],
+						pData[1], pData[2]);
+					seq[nSeq].def = pData[3];
+					seq[nSeq++].delay_us = 0;
+					nCommand++;
+				}
+				nResult = tas_dev->multi_write(tas_dev, chn,
+					seq, nSeq);
 				if (nResult < 0)
 					goto end;
-				if (block->mbYChkSumPresent) {
-					nResult = doSingleRegCheckSum(tas_dev,
-						chn, nBook, nPage, nOffset,
-						nData);
-					if (nResult < 0)
-						goto check;
-					nCRCChkSum  += (unsigned char)nResult;
-				}
+			} else if (nOffset <= 0x7F) {
+				nResult = doSingleRegCheckSum(tas_dev, chn,
+					nBook, nPage, nOffset, nData);
+				if (nResult == -EAGAIN)
+					goto check;
+				if (nResult < 0)
+					goto end;
+				nCRCChkSum  += (unsigned char)nResult;
 			} else if (nOffset == 0x81) {
 				nSleep = (nBook << 8) + nPage;
-				msleep(nSleep);
+				tasdevice_delay_ms(nSleep);
 			} else if (nOffset == 0x85) {
 				pData  += 4;
 				nLength = (nBook << 8) + nPage;
 				nBook = pData[0];
 				nPage = pData[1];
 				nOffset = pData[2];
-				if (nLength > 1) {
+				if (nLength > 1 && block->mbYChkSumPresent) {
+					nResult = doMultiRegCheckSum(tas_dev,
+						chn, nBook, nPage, nOffset,
+						pData + 3, nLength);
+					if (nResult == -EAGAIN)
+						goto check;
+					if (nResult < 0)
+						goto end;
+					nCRCChkSum  += (unsigned char)nResult;
+				} else if (nLength > 1) {
 					nResult = tas_dev->bulk_write(tas_dev,
 						chn, TASDEVICE_REG(nBook,
 						nPage, nOffset), pData + 3,
 						nLength);
 					if (nResult < 0)
 						goto end;
-					if (block->mbYChkSumPresent) {
-						nResult = doMultiRegCheckSum(
-							tas_dev, chn, nBook,
-							nPage, nOffset,
-							nLength);
-						if (nResult < 0)
-							goto check;
-						nCRCChkSum  +=
-							(unsigned char)nResult;
-					}
+				} else if (block->mbYChkSumPresent) {
+					nResult = doSingleRegCheckSum(tas_dev,
+						chn, nBook, nPage, nOffset,
+						pData[3]);
+					if (nResult == -EAGAIN)
+						goto check;
+					if (nResult < 0)
+						goto end;
+					nCRCChkSum  += (unsigned char)nResult;
 				} else {
 					nResult = tas_dev->write(tas_dev, chn,
 						TASDEVICE_REG(nBook, nPage,
@@ -1079,16 +1132,6 @@ start:
 						pData[3]);
 					if (nResult < 0)
 						goto end;
-					if (block->mbYChkSumPresent) {
-						nResult = doSingleRegCheckSum(
-							tas_dev, chn, nBook,
-							nPage, nOffset,
-							pData[3]);
-						if (nResult < 0)
-							goto check;
-						nCRCChkSum  +=
-							(unsigned char)nResult;
-					}
 				}
 
 				nCommand++;
@@ -1155,8 +1198,15 @@ check:
 				nRetry = 6;
 			}
 		}
+		tas_dev->tasdevice[chn].bNoShadow = false;
+		tasdevice_session_end(tas_dev, chn);
+		bSession = false;
 	}
 end:
+	if (chn < chnend)
+		tas_dev->tasdevice[chn].bNoShadow = false;
+	if (bSession)
+		tasdevice_session_end(tas_dev, chn);
 	if (nResult < 0) {
 		dev_err(tas_dev->dev, "Block (%d) load error\n",
 				block->type);
@@ -1165,12 +1215,357 @@ end:
 }
 
 
+static bool tasdevice_is_swap_reg(unsigned char nBook, unsigned char nPage,
+	unsigned char nReg)
+{
+	return nBook == TASDEVICE_BOOK_ID(TAS2781_SA_COEFF_SWAP_REG) &&
+		nPage == TASDEVICE_PAGE_ID(TAS2781_SA_COEFF_SWAP_REG) &&
+		nReg >= TASDEVICE_PAGE_REG(TAS2781_SA_COEFF_SWAP_REG) &&
+		nReg <= TASDEVICE_PAGE_REG(TAS2781_SA_COEFF_SWAP_REG) + 4;
+}
+
+/*
+ * Device a per-device block is meant for, or -1 if it is addressed to
+ * all devices or must not be folded into a broadcast (software reset
+ * blocks drop the global address mode half way). kind separates main
+ * blocks from coeff/pre ones, as in dev_idx.
+ */
+static int tasdevice_block_dev(struct tasdevice_priv *tas_dev,
+	struct TBlock *block, unsigned char *kind)
+{
+	int dev = -1;
+
+	if (tas_dev->fmw->bKernelFormat) {
+		if ((block->type & 0xF0) == 0x40)
+			return -1;
+		*kind = block->dev_idx & 0xC0;
+		dev = (block->dev_idx & 0x3F) - 1;
+		return (dev < tas_dev->ndev) ? dev : -1;
+	}
+
+	*kind = 0xC0;
+	switch (block->type) {
+	case MAIN_DEVICE_A:
+	case MAIN_DEVICE_B:
+	case MAIN_DEVICE_C:
+	case MAIN_DEVICE_D:
+		*kind = 0x80;
+		break;
+	default:
+		break;
+	}
+	switch (block->type) {
+	case MAIN_DEVICE_A:
+	case COEFF_DEVICE_A:
+	case PRE_DEVICE_A:
+		dev = 0;
+		break;
+	case MAIN_DEVICE_B:
+	case COEFF_DEVICE_B:
+	case PRE_DEVICE_B:
+		dev = 1;
+		break;
+	case MAIN_DEVICE_C:
+	case COEFF_DEVICE_C:
+	case PRE_DEVICE_C:
+		dev = 2;
+		break;
+	case MAIN_DEVICE_D:
+	case COEFF_DEVICE_D:
+	case PRE_DEVICE_D:
+		dev = 3;
+		break;
+	default:
+		break;
+	}
+	return (dev < tas_dev->ndev) ? dev : -1;
+}
+
+static bool tasdevice_block_same(struct TBlock *a, struct TBlock *b)
+{
+	unsigned int len = a->blk_size ? a->blk_size : a->mnCommands * 4;
+
+	return a->blk_size == b->blk_size &&
+		a->mnCommands == b->mnCommands &&
+		a->nSublocks == b->nSublocks &&
+		a->mbPChkSumPresent == b->mbPChkSumPresent &&
+		a->mnPChkSum == b->mnPChkSum &&
+		a->mbYChkSumPresent == b->mbYChkSumPresent &&
+		a->mnYChkSum == b->mnYChkSum &&
+		!memcmp(a->mpData, b->mpData, len);
+}
+
+/*
+ * Look for per-device blocks that carry the same payload for every
+ * device and mark them, so tasdevice_load_data() can send them once
+ * through the broadcast address. A copy is only folded into an earlier
+ * one when no block in between touches its device, so each chip still
+ * sees its writes in firmware order.
+ */
+static void tasdevice_find_bcast(struct tasdevice_priv *tas_dev,
+	struct TData *pData)
+{
+	unsigned int all = GENMASK(tas_dev->ndev - 1, 0);
+	unsigned int dup[TASDEVICE_MAX_CHANNELS];
+	unsigned int mask, touched, i, j;
+	unsigned char kind_a = 0, kind_b = 0;
+	struct TBlock *a, *b;
+	int dev, lead_dev;
+
+	if (tas_dev->ndev < 2 || !pData->mpBlocks)
+		return;
+
+	for (i = 0; i < pData->mnBlocks; i++) {
+		a = &(pData->mpBlocks[i]);
+		if (a->nBcastLead)
+			continue;
+		lead_dev = tasdevice_block_dev(tas_dev, a, &kind_a);
+		if (lead_dev < 0)
+			continue;
+
+		mask = BIT(lead_dev);
+		touched = 0;
+		for (j = i + 1; j < pData->mnBlocks && mask != all; j++) {
+			b = &(pData->mpBlocks[j]);
+			dev = tasdevice_block_dev(tas_dev, b, &kind_b);
+			if (dev < 0)
+				break;
+			if (!b->nBcastLead && kind_b == kind_a &&
+				!((mask | touched) & BIT(dev)) &&
+				tasdevice_block_same(a, b)) {
+				mask |= BIT(dev);
+				dup[dev] = j;
+			} else
+				touched |= BIT(dev);
+		}
+		if (mask != all)
+			continue;
+
+		a->bBcast = true;
+		for (dev = 0; dev < tas_dev->ndev; dev++) {
+			if (dev != lead_dev)
+				pData->mpBlocks[dup[dev]].nBcastLead = i + 1;
+		}
+		dev_info(tas_dev->dev, "%s: %s block %u goes out by broadcast\n",
+			__func__, pData->mpName, i);
+	}
+}
+
+/*
+ * Send a git format block to chn as is, with no per-register readback;
+ * used for the broadcast copy of per-device blocks.
+ */
+static int tasdevice_send_block(struct tasdevice_priv *tas_dev,
+	struct TBlock *block, unsigned short chn)
+{
+	struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+	unsigned int nCommand = 0, nLength = 0;
+	unsigned char *pData;
+	int nSeq = 0, nResult = 0;
+
+	while (nCommand < block->mnCommands) {
+		pData = block->mpData + nCommand * 4;
+		nCommand++;
+
+		if (pData[2] <= 0x7F) {
+			seq[nSeq].reg = TASDEVICE_REG(pData[0], pData[1],
+				pData[2]);
+			seq[nSeq].def = pData[3];
+			seq[nSeq++].delay_us = 0;
+			if (nSeq < TASDEVICE_SEQ_CHUNK &&
+				nCommand < block->mnCommands &&
+				block->mpData[nCommand * 4 + 2] <= 0x7F)
+				continue;
+			nResult = tas_dev->multi_write(tas_dev, chn, seq,
+				nSeq);
+			nSeq = 0;
+		} else if (pData[2] == 0x81) {
+			tasdevice_delay_ms((pData[0] << 8) + pData[1]);
+		} else if (pData[2] == 0x85) {
+			nLength = (pData[0] << 8) + pData[1];
+			pData  += 4;
+			if (nLength > 1)
+				nResult = tas_dev->bulk_write(tas_dev, chn,
+					TASDEVICE_REG(pData[0], pData[1],
+					pData[2]), pData + 3, nLength);
+			else
+				nResult = tas_dev->write(tas_dev, chn,
+					TASDEVICE_REG(pData[0], pData[1],
+					pData[2]), pData[3]);
+			nCommand++;
+			if (nLength >= 2)
+				nCommand  += ((nLength - 2) / 4) + 1;
+		}
+		if (nResult < 0)
+			break;
+	}
+	return nResult;
+}
+
+/* Compare the YRAM part of a write with what one chip holds */
+static int tasdevice_yram_verify(struct tasdevice_priv *tas_dev,
+	unsigned short chn, unsigned char nBook, unsigned char nPage,
+	unsigned char nReg, unsigned char *pData, unsigned int len)
+{
+	unsigned char nBuf1[128];
+	struct TYCRC TCRCData;
+	int nResult = 0, i = 0, j = 0;
+
+	if (nReg + len > 128)
+		return -EINVAL;
+	if (isYRAM(tas_dev, &TCRCData, nBook, nPage, nReg, len) != 1)
+		return 0;
+
+	nResult = tasdevice_dev_bulk_read_nocache(tas_dev, chn,
+		TASDEVICE_REG(nBook, nPage, TCRCData.mnOffset), nBuf1,
+		TCRCData.mnLen);
+	if (nResult < 0)
+		return nResult;
+
+	for (i = 0; i < TCRCData.mnLen; i++) {
+		if (tasdevice_is_swap_reg(nBook, nPage,
+			i + TCRCData.mnOffset))
+			continue;
+		j = i + TCRCData.mnOffset - nReg;
+		if (nBuf1[i] != pData[j]) {
+			dev_err(tas_dev->dev, "%s: chn %d B[0x%x]P[0x%x]"
+				"R[0x%x] W[0x%x], R[0x%x]\n", __func__, chn,
+				nBook, nPage, nReg + j, pData[j], nBuf1[i]);
+			tas_dev->tasdevice[chn].mnErrCode |=
+				ERROR_YRAM_CRCCHK;
+			return -EAGAIN;
+		}
+	}
+	return 0;
+}
+
+/* Read back every YRAM write of a git format block from one chip */
+static int tasdevice_verify_block(struct tasdevice_priv *tas_dev,
+	struct TBlock *block, unsigned short chn)
+{
+	unsigned int nCommand = 0, nLength = 0;
+	unsigned char *pData;
+	int nResult = 0;
+
+	while (nCommand < block->mnCommands) {
+		pData = block->mpData + nCommand * 4;
+		nCommand++;
+
+		if (pData[2] <= 0x7F) {
+			nResult = tasdevice_yram_verify(tas_dev, chn, pData[0],
+				pData[1], pData[2], &pData[3], 1);
+		} else if (pData[2] == 0x85) {
+			nLength = (pData[0] << 8) + pData[1];
+			pData  += 4;
+			nResult = tasdevice_yram_verify(tas_dev, chn, pData[0],
+				pData[1], pData[2], pData + 3, nLength);
+			nCommand++;
+			if (nLength >= 2)
+				nCommand  += ((nLength - 2) / 4) + 1;
+		}
+		if (nResult < 0)
+			break;
+	}
+	return nResult;
+}
+
+/*
+ * Send a block marked by tasdevice_find_bcast() once through the
+ * broadcast address, then check the checksums of each chip on its own.
+ * Any error means the caller falls back to per-device downloads.
+ */
+static int tasdevice_load_block_bcast(struct tasdevice_priv *tas_dev,
+	struct TBlock *block)
+{
+	unsigned short bcast = tas_dev->ndev;
+	unsigned int nValue = 0;
+	int i = 0, nResult = 0;
+
+	/* A program download may have reset the chips */
+	tas_dev->set_global_mode(tas_dev);
+
+	nResult = tasdevice_session_begin(tas_dev, bcast);
+	if (nResult < 0)
+		goto out;
+
+	if (block->mbPChkSumPresent) {
+		nResult = tas_dev->write(tas_dev, bcast,
+			TASDEVICE_I2CChecksum, 0);
+		if (nResult < 0)
+			goto end;
+		for (i = 0; i < tas_dev->ndev; i++)
+			tas_dev->tasdevice[i].bNoShadow = true;
+	}
+
+	if (tas_dev->fmw->bKernelFormat) {
+		tas_dev->tasdevice[bcast].bLoaderr = false;
+		nResult = tasdevice_load_block_kernel_idx(tas_dev, block,
+			block->dev_idx & 0xC0);
+		if (nResult == 0 && tas_dev->tasdevice[bcast].bLoaderr)
+			nResult = -EIO;
+	} else
+		nResult = tasdevice_send_block(tas_dev, block, bcast);
+	for (i = 0; i < tas_dev->ndev; i++)
+		tas_dev->tasdevice[i].bNoShadow = false;
+	if (nResult < 0)
+		goto end;
+
+	for (i = 0; i < tas_dev->ndev; i++) {
+		if (block->mbPChkSumPresent) {
+			nResult = tas_dev->read(tas_dev, i,
+				TASDEVICE_I2CChecksum, &nValue);
+			if (nResult < 0)
+				goto end;
+			if ((nValue & 0xff) != block->mnPChkSum) {
+				dev_err(tas_dev->dev, "%s: PChkSum Channel %d "
+					"Error: FW = 0x%x, Reg = 0x%x\n",
+					__func__, i, block->mnPChkSum,
+					(nValue & 0xff));
+				tas_dev->tasdevice[i].mnErrCode |=
+					ERROR_PRAM_CRCCHK;
+				nResult = -EAGAIN;
+				goto end;
+			}
+			tas_dev->tasdevice[i].mnErrCode &= ~ERROR_PRAM_CRCCHK;
+		}
+		if (block->mbYChkSumPresent && !tas_dev->fmw->bKernelFormat) {
+			nResult = tasdevice_verify_block(tas_dev, block, i);
+			if (nResult < 0)
+				goto end;
+			tas_dev->tasdevice[i].mnErrCode &= ~ERROR_YRAM_CRCCHK;
+		}
+	}
+end:
+	tasdevice_session_end(tas_dev, bcast);
+out:
+	if (nResult < 0)
+		dev_err(tas_dev->dev, "%s: Block[0x%02x] falls back to "
+			"per-device load, %d\n", __func__, block->type,
+			nResult);
+	return nResult;
+}
+
+/* Broadcast needs every chip listening and taking this download */
+static bool tasdevice_bcast_ready(struct tasdevice_priv *tas_dev)
+{
+	int i;
+
+	if (!tas_dev->set_global_mode)
+		return false;
+	for (i = 0; i < tas_dev->ndev; i++) {
+		if (!tas_dev->tasdevice[i].bLoading)
+			return false;
+	}
+	return true;
+}
+
 static int tasdevice_load_data(struct tasdevice_priv *tas_dev,
 	struct TData *pData)
 {
 	int nResult = 0;
 	unsigned int nBlock = 0;
 	struct TBlock *block = NULL;
+	bool bBcast = tasdevice_bcast_ready(tas_dev);
 
 	dev_info(tas_dev->dev, "%s: TAS2781 load data: %s, Blocks = %d\n",
 		__func__,
@@ -1178,7 +1573,26 @@ static int tasdevice_load_data(struct tasdevice_priv *tas_dev,
 
 	for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
 		block = &(pData->mpBlocks[nBlock]);
+		if (block->nBcastLead) {
+			if (pData->mpBlocks[block->nBcastLead - 1].bBcastDone)
+				continue;
+		} else if (block->bBcast) {
+			block->bBcastDone = false;
+			if (bBcast) {
+				trace_tasdevice_block_begin(block->type,
+					block->dev_idx, true, block->blk_size);
+				nResult = tasdevice_load_block_bcast(tas_dev,
+					block);
+				trace_tasdevice_block_end(block->type, nResult);
+				block->bBcastDone = !nResult;
+			}
+			if (block->bBcastDone)
+				continue;
+		}
+		trace_tasdevice_block_begin(block->type, block->dev_idx, false,
+			block->blk_size);
 		nResult = tas_dev->tasdevice_load_block(tas_dev, block);
+		trace_tasdevice_block_end(block->type, nResult);
 		if (nResult < 0)
 			break;
 	}
@@ -1186,8 +1600,14 @@ static int tasdevice_load_data(struct tasdevice_priv *tas_dev,
 	return nResult;
 }
 
+/* Worker of tasdevice_bus_parallel(), arg is the struct TData */
+static int tasdevice_load_data_bus(struct tasdevice_priv *tas_dev, void *arg)
+{
+	return tasdevice_load_data(tas_dev, arg);
+}
+
 static int tasdevice_load_calibrated_data(
-	struct tasdevice_priv *tas_dev, struct TData *pData)
+	struct tasdevice_priv *tas_dev, unsigned short chn, struct TData *pData)
 {
 	int nResult = 0;
 	unsigned int nBlock = 0;
@@ -1197,12 +1617,17 @@ static int tasdevice_load_calibrated_data(
 		__func__,
 		pData->mpName, pData->mnBlocks);
 
+	trace_tasdevice_load_begin(TASDEVICE_LOAD_CALIBRATION, chn);
 	for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
 		block = &(pData->mpBlocks[nBlock]);
+		trace_tasdevice_block_begin(block->type, block->dev_idx, false,
+			block->blk_size);
 		nResult = tasdevice_load_block(tas_dev, block);
+		trace_tasdevice_block_end(block->type, nResult);
 		if (nResult < 0)
 			break;
 	}
+	trace_tasdevice_load_end(TASDEVICE_LOAD_CALIBRATION, chn, nResult);
 
 	return nResult;
 }
@@ -1338,8 +1763,9 @@ int tasdevice_dspfw_ready(const void *pVoid, void *pContext)
 	const struct firmware *pFW = (const struct firmware *)pVoid;
 	struct tasdevice_fw *pFirmware = NULL;
 	struct tasdevice_fw_fixed_hdr *fw_fixed_hdr;
-	int offset = 0, ret = 0;
+	int offset = 0, ret = 0, i = 0;
 
+	trace_tasdevice_load_begin(TASDEVICE_LOAD_DSPFW, -1);
 	if (!pFW || !pFW->data) {
 		dev_err(tas_dev->dev, "%s: Failed to read firmware %s\n",
 			__func__, tas_dev->dsp_binaryname);
@@ -1406,10 +1832,21 @@ int tasdevice_dspfw_ready(const void *pVoid, void *pContext)
 		goto out;
 	}
 	offset = tas_dev->fw_parse_configuration_data(pFirmware, pFW, offset);
-	if (offset < 0)
+	if (offset < 0) {
 		ret = -1;
+		goto out;
+	}
+
+	for (i = 0; i < pFirmware->nr_programs; i++)
+		tasdevice_find_bcast(tas_dev,
+			&(pFirmware->mpPrograms[i].mData));
+	for (i = 0; i < pFirmware->nr_configurations; i++)
+		tasdevice_find_bcast(tas_dev,
+			&(pFirmware->mpConfigurations[i].mData));
 
 out:
+	trace_tasdevice_load_end(TASDEVICE_LOAD_DSPFW, -1,
+		offset < 0 && !ret ? -EINVAL : ret);
 	return ret;
 }
 
@@ -1523,7 +1960,7 @@ int tasdevice_select_tuningprm_cfg(void *pContext, int prm_no,
 	struct tasdevice_fw *pFirmware = tas_dev->fmw;
 	struct TConfiguration *pConfigurations = NULL;
 	struct TProgram *pProgram = NULL;
-	int i = 0, status = 0, prog_status = 0;
+	int i = 0, status = 0, prog_status = 0, ret;
 
 	if (pFirmware == NULL) {
 		dev_err(tas_dev->dev, "%s: Firmware is NULL\n", __func__);
@@ -1576,7 +2013,10 @@ int tasdevice_select_tuningprm_cfg(void *pContext, int prm_no,
 
 	if (prog_status) {
 		pProgram = &(pFirmware->mpPrograms[prm_no]);
-		tasdevice_load_data(tas_dev, &(pProgram->mData));
+		trace_tasdevice_load_begin(TASDEVICE_LOAD_PROGRAM, prm_no);
+		ret = tasdevice_bus_parallel(tas_dev,
+			tasdevice_load_data_bus, &(pProgram->mData));
+		trace_tasdevice_load_end(TASDEVICE_LOAD_PROGRAM, prm_no, ret);
 		for (i = 0; i < tas_dev->ndev; i++) {
 			if (tas_dev->tasdevice[i].bLoaderr == true) {
 				tas_dev->tasdevice[i].mnCurrentProgram = -1;
@@ -1606,7 +2046,10 @@ int tasdevice_select_tuningprm_cfg(void *pContext, int prm_no,
 
 	if (status) {
 		status = 0;
-		tasdevice_load_data(tas_dev, &(pConfigurations->mData));
+		trace_tasdevice_load_begin(TASDEVICE_LOAD_CONFIG, cfg_no);
+		ret = tasdevice_bus_parallel(tas_dev,
+			tasdevice_load_data_bus, &(pConfigurations->mData));
+		trace_tasdevice_load_end(TASDEVICE_LOAD_CONFIG, cfg_no, ret);
 		for (i = 0; i < tas_dev->ndev; i++) {
 			if (tas_dev->tasdevice[i].mnCurrentProgram == -1) {
 				status |= 1 << (i + 4);
@@ -1622,7 +2065,7 @@ int tasdevice_select_tuningprm_cfg(void *pContext, int prm_no,
 
 					if (cal)
 						tasdevice_load_calibrated_data(
-							tas_dev, &(cal->mData));
+							tas_dev, i, &(cal->mData));
 				}
 				tas_dev->tasdevice[i].mnCurrentConfiguration
 					= cfg_no;
@@ -1644,6 +2087,20 @@ out:
 	return prog_status;
 }
 
+/* Amps on a second adapter may reuse addresses, tell their files apart */
+void tasdevice_cal_binaryname(struct tasdevice_priv *tas_dev,
+	unsigned short i)
+{
+	if (tas_dev->tasdevice[i].bus)
+		scnprintf(tas_dev->cal_binaryname[i], 64,
+			"%s-%u-0x%02x-cal.bin", tas_dev->dev_name,
+			tas_dev->tasdevice[i].bus,
+			tas_dev->tasdevice[i].mnDevAddr);
+	else
+		scnprintf(tas_dev->cal_binaryname[i], 64, "%s-0x%02x-cal.bin",
+			tas_dev->dev_name, tas_dev->tasdevice[i].mnDevAddr);
+}
+
 int tas2781_set_calibration(void *pContext, unsigned short i,
 	int nCalibration)
 {
@@ -1670,8 +2127,7 @@ int tas2781_set_calibration(void *pContext, unsigned short i,
 			tasdevice->mpCalFirmware = NULL;
 		}
 
-		scnprintf(tas_dev->cal_binaryname[i], 64, "%s-0x%02x-cal.bin",
-			tas_dev->dev_name, tas_dev->tasdevice[i].mnDevAddr);
+		tasdevice_cal_binaryname(tas_dev, i);
 		nResult = tas2781_load_calibration(tas_dev,
 			tas_dev->cal_binaryname[i], i);
 		if (nResult != 0) {
@@ -1687,7 +2143,8 @@ int tas2781_set_calibration(void *pContext, unsigned short i,
 		struct calibration_t *cal = cal_fw->mpCalibrations;
 
 		if (cal)
-			tasdevice_load_calibrated_data(tas_dev, &(cal->mData));
+			tasdevice_load_calibrated_data(tas_dev, i,
+				&(cal->mData));
 	} else {
 		dev_err(tas_dev->dev, "%s: No calibrated data for device %d\n",
 			__func__, i);
@@ -1734,7 +2191,8 @@ int tasdevice_calbin_load(void *ctxt)
 		struct calibration_t *cal = cal_fw->mpCalibrations;
 
 		if (cal)
-			tasdevice_load_calibrated_data(tas_pri, &(cal->mData));
+			tasdevice_load_calibrated_data(tas_pri, i,
+				&(cal->mData));
 	} else {
 		dev_err(tas_pri->dev, "%s: No calibrated data for device %d\n",
 			__func__, i);
@@ -81,6 +81,11 @@ struct TBlock {
 	unsigned int nSublocks;
 	unsigned char dev_idx;
 	unsigned char *mpData;
+	/* Same payload for every device, sent once through glb_addr */
+	bool bBcast;
+	bool bBcastDone;
+	/* 1 + index of the block whose broadcast carries this one */
+	unsigned int nBcastLead;
 };
 
 struct TData {
@@ -145,6 +150,8 @@ int tas2781_load_calibration(void *ctxt, char *pFileName,
 	unsigned short i);
 int tas2781_set_calibration(void *ctxt, unsigned short i,
 	int nCalibration);
+void tasdevice_cal_binaryname(struct tasdevice_priv *tas_dev,
+	unsigned short i);
 int tasdevice_select_tuningprm_cfg(void *ctxt, int prm,
 	int cfg_no, int regbin_conf_no);
 int tasdevice_calbin_load(void *ctxt);
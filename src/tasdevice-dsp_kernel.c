@@ -579,8 +579,9 @@ out:
 	return offset;
 }
 
-int tasdevice_load_block_kernel(struct tasdevice_priv *tas_priv,
-	struct TBlock *block)
+/* Send the sublocks of a block as if it were addressed to dev_idx */
+int tasdevice_load_block_kernel_idx(struct tasdevice_priv *tas_priv,
+	struct TBlock *block, unsigned char dev_idx)
 {
 	int nResult = 0;
 
@@ -590,7 +591,7 @@ int tasdevice_load_block_kernel(struct tasdevice_priv *tas_priv,
 
 	for (i = 0; i < block->nSublocks; i++) {
 		int rc = tasdevice_process_block(tas_priv, pData + length,
-			block->dev_idx, blk_size - length);
+			dev_idx, blk_size - length);
 		if (rc < 0) {
 			dev_err(tas_priv->dev, "%s: ERROR:%u %u sublock write "
 				"error\n", __func__, length, blk_size);
@@ -606,3 +607,10 @@ int tasdevice_load_block_kernel(struct tasdevice_priv *tas_priv,
 
 	return nResult;
 }
+
+int tasdevice_load_block_kernel(struct tasdevice_priv *tas_priv,
+	struct TBlock *block)
+{
+	return tasdevice_load_block_kernel_idx(tas_priv, block,
+		block->dev_idx);
+}
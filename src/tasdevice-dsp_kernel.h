@@ -25,4 +25,6 @@ int fw_parse_configuration_data_kernel(
 	int offset);
 int tasdevice_load_block_kernel(struct tasdevice_priv *pTAS2781,
 	struct TBlock *pBlock);
+int tasdevice_load_block_kernel_idx(struct tasdevice_priv *pTAS2781,
+	struct TBlock *pBlock, unsigned char dev_idx);
 #endif
@@ -31,6 +31,7 @@
 
 #include "tasdevice.h"
 #include "tasdevice-misc.h"
+#include "tasdevice-rw.h"
 
 #define	TIAUDIO_CMD_REG_WITE			1
 #define	TIAUDIO_CMD_REG_READ			2
@@ -39,7 +40,7 @@
 static int tasdev_fct_read(struct tasdevice_priv *tas_dev,
 	char *buf, size_t count)
 {
-	unsigned int nCompositeRegister, Value;
+	unsigned int nCompositeRegister;
 	char rd_data[MAX_LENGTH];
 	char reg_addr;
 	size_t size;
@@ -56,15 +57,10 @@ static int tasdev_fct_read(struct tasdevice_priv *tas_dev,
 
 	nCompositeRegister = TASDEVICE_REG(tas_dev->rwinfo.mBook,
 				tas_dev->rwinfo.mPage, reg_addr);
-	if (count == 1) {
-		ret = tas_dev->read(tas_dev, tas_dev->rwinfo.mnCurrentChannel,
-				nCompositeRegister, &Value);
-		rd_data[0] = Value;
-	} else if (count > 1) {
-		ret = tas_dev->bulk_read(tas_dev,
-			tas_dev->rwinfo.mnCurrentChannel, nCompositeRegister,
-			rd_data, size);
-	}
+	/* The tools want what the chip holds, not the register cache */
+	ret = tasdevice_dev_bulk_read_nocache(tas_dev,
+		tas_dev->rwinfo.mnCurrentChannel, nCompositeRegister,
+		rd_data, size);
 	if (ret < 0) {
 		dev_err(tas_dev->dev,
 			"%s, ret=%d, count=%zu error happen!\n",
@@ -84,7 +80,7 @@ out:
 static int tasdev_rccd2_read(struct tasdevice_priv *tas_dev,
 	char *buf, size_t count)
 {
-	unsigned int nCompositeRegister, Value;
+	unsigned int nCompositeRegister;
 	char rd_data[MAX_LENGTH];
 	size_t size = count;
 	int ret;
@@ -98,15 +94,9 @@ static int tasdev_rccd2_read(struct tasdevice_priv *tas_dev,
 	nCompositeRegister = TASDEVICE_REG(tas_dev->rwinfo.mBook,
 		tas_dev->rwinfo.mPage, tas_dev->rwinfo.mnCurrentReg);
 
-	if (count == 1) {
-		ret = tas_dev->read(tas_dev, tas_dev->rwinfo.mnCurrentChannel,
-			nCompositeRegister, &Value);
-		rd_data[0] = Value;
-	} else if (count > 1) {
-		ret = tas_dev->bulk_read(tas_dev,
-			tas_dev->rwinfo.mnCurrentChannel, nCompositeRegister,
-			rd_data, count);
-	}
+	ret = tasdevice_dev_bulk_read_nocache(tas_dev,
+		tas_dev->rwinfo.mnCurrentChannel, nCompositeRegister,
+		rd_data, count);
 
 	if (ret < 0) {
 		dev_err(tas_dev->dev,
@@ -170,13 +160,13 @@ static int tasdev_rccd2_dsp_read(struct tasdevice_priv *tas_dev,
 	}
 	nCompositeRegister = TASDEVICE_REG(rd_data[1], rd_data[2], rd_data[3]);
 
-	if (count - 4 != 1) {
-		ret = tas_dev->bulk_read(tas_dev, idx, nCompositeRegister,
-			&rd_data[4], count - 4);
-	} else {
-		ret = tas_dev->read(tas_dev, idx, nCompositeRegister,
-			(unsigned int *)&rd_data[4]);
-	}
+	/* One tiload request is one bus session, on the amp it names */
+	ret = tasdevice_session_begin(tas_dev, idx);
+	if (ret < 0)
+		return ret;
+	ret = tasdevice_dev_bulk_read_nocache(tas_dev, idx,
+		nCompositeRegister, &rd_data[4], count - 4);
+	tasdevice_session_end(tas_dev, idx);
 
 	if (ret < 0) {
 		dev_err(tas_dev->dev, "%s, ret=%d, count=%d, ERROR Happen\n",
@@ -200,7 +190,9 @@ static ssize_t tasdevice_read(struct file *file, char *buf,
 	struct miscdevice *dev = file->private_data;
 	struct tasdevice_priv *tas_dev = container_of(dev,
 		struct tasdevice_priv, misc_dev);
+	unsigned short chn;
 	size_t size;
+	int ret;
 
 	mutex_lock(&tas_dev->file_lock);
 
@@ -211,18 +203,25 @@ static ssize_t tasdevice_read(struct file *file, char *buf,
 		goto out;
 	}
 
+	/* The DSP read names its amp itself, and opens its own session */
+	if (tas_dev->rwinfo.mnDBGCmd != TIAUDIO_CMD_REG_FCT &&
+		tas_dev->rwinfo.mnDBGCmd != TIAUDIO_CMD_REG_READ) {
+		size = tasdev_rccd2_dsp_read(tas_dev, buf, count);
+		goto out;
+	}
 
-	switch (tas_dev->rwinfo.mnDBGCmd) {
-	case TIAUDIO_CMD_REG_FCT:
-	size = tasdev_fct_read(tas_dev, buf, count);
-		break;
-	case TIAUDIO_CMD_REG_READ:
-	size = tasdev_rccd2_read(tas_dev, buf, count);
-		break;
-	default:
-	size = tasdev_rccd2_dsp_read(tas_dev, buf, count);
-		break;
+	/* One tiload request is one bus session */
+	chn = tas_dev->rwinfo.mnCurrentChannel;
+	ret = tasdevice_session_begin(tas_dev, chn);
+	if (ret < 0) {
+		size = ret;
+		goto out;
 	}
+	if (tas_dev->rwinfo.mnDBGCmd == TIAUDIO_CMD_REG_FCT)
+		size = tasdev_fct_read(tas_dev, buf, count);
+	else
+		size = tasdev_rccd2_read(tas_dev, buf, count);
+	tasdevice_session_end(tas_dev, chn);
 out:
 	tas_dev->rwinfo.mnDBGCmd = 0;
 	mutex_unlock(&tas_dev->file_lock);
@@ -256,8 +255,13 @@ static int tasdev_rccd2_dsp_write(struct tasdevice_priv *tas_dev,
 	}
 	nCompositeRegister = TASDEVICE_REG(pData[1], pData[2], pData[3]);
 
+	/* One tiload request is one bus session, on the amp it names */
+	ret = tasdevice_session_begin(tas_dev, idx);
+	if (ret < 0)
+		return ret;
 	ret = tas_dev->bulk_write(tas_dev, idx, nCompositeRegister, &pData[4],
 		count - 4);
+	tasdevice_session_end(tas_dev, idx);
 
 	if (ret < 0) {
 		size = ret;
@@ -391,6 +395,7 @@ static ssize_t tasdevice_write(struct file *file, const char *buf,
 	struct tasdevice_priv *tas_dev = container_of(dev, struct
 		tasdevice_priv, misc_dev);
 	char wr_data[MAX_LENGTH];
+	unsigned short chn;
 	int size;
 
 	mutex_lock(&tas_dev->file_lock);
@@ -419,7 +424,12 @@ static ssize_t tasdevice_write(struct file *file, const char *buf,
 	}
 
 	if (count <= 5) {
+		chn = tas_dev->rwinfo.mnCurrentChannel;
+		size = tasdevice_session_begin(tas_dev, chn);
+		if (size < 0)
+			goto out;
 		size = tasdev_fct_write(tas_dev, wr_data, count);
+		tasdevice_session_end(tas_dev, chn);
 		goto out;
 	}
 
@@ -434,7 +444,12 @@ static ssize_t tasdevice_write(struct file *file, const char *buf,
 		tas_dev->rwinfo.mBook = TASDEVICE_BOOK_ID(reg);
 		tas_dev->rwinfo.mPage = TASDEVICE_PAGE_ID(reg);
 		tas_dev->rwinfo.mnCurrentReg = TASDEVICE_PAGE_REG(reg);
+		chn = tas_dev->rwinfo.mnCurrentChannel;
+		size = tasdevice_session_begin(tas_dev, chn);
+		if (size < 0)
+			goto out;
 		size = tasdev_rccd2_tas_write(tas_dev, wr_data, count, 6);
+		tasdevice_session_end(tas_dev, chn);
 		goto out;
 	}
 
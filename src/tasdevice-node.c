@@ -244,15 +244,13 @@ ssize_t active_address_show(struct device *dev,
 
 	if (tas_dev != NULL) {
 #ifdef CONFIG_TASDEV_CODEC_SPI
-		struct spi_device *client =
-			(struct spi_device *)tas_dev->client;
 		n  += scnprintf(buf, size,
-			"Active SmartPA - chn0x%02x\n", client->chip_select);
+			"Active SmartPA - chn0x%02x\n",
+			tas_dev->tasdevice[tas_dev->act_chn].mnDevAddr);
 #else
-		struct i2c_client *client =
-			(struct i2c_client *)tas_dev->client;
 		n  += scnprintf(buf, size,
-			"Active SmartPA - addr0x%02x\n", client->addr);
+			"Active SmartPA - addr0x%02x\n",
+			tas_dev->tasdevice[tas_dev->act_chn].mnDevAddr);
 #endif
 	}
 	return n;
@@ -284,7 +282,7 @@ ssize_t reg_show(struct device *dev,
 		//15 bytes
 #ifdef CONFIG_TASDEV_CODEC_SPI
 		len  += scnprintf(buf + len, size - len, "spi - chn: 0x%02x\n",
-			client->chip_select);
+			tas_dev->tasdevice[pSysCmd->mnCurrentChannel].mnDevAddr);
 #else
 		len  += scnprintf(buf + len, size - len,
 			"i2c - addr: 0x%02x\n",
@@ -292,7 +290,7 @@ ssize_t reg_show(struct device *dev,
 #endif
 		//2560 bytes
 
-		n_result = tasdevice_dev_read(tas_dev,
+		n_result = tasdevice_dev_read_nocache(tas_dev,
 			pSysCmd->mnCurrentChannel,
 			TASDEVICE_REG(pSysCmd->mnBook, pSysCmd->mnPage,
 			pSysCmd->mnReg), &data);
@@ -433,7 +431,8 @@ ssize_t regdump_show(struct device *dev,
 		if (len + 20 <= size)
 #ifdef CONFIG_TASDEV_CODEC_SPI
 			len  += scnprintf(buf + len, size - len,
-				"addr: 0x%02x\n\r", client->chip_select);
+				"addr: 0x%02x\n\r",
+				tas_dev->tasdevice[pSysCmd->mnCurrentChannel].mnDevAddr);
 #else
 			len  += scnprintf(buf + len, size - len,
 				"addr: 0x%02x\n\r",
@@ -449,7 +448,7 @@ ssize_t regdump_show(struct device *dev,
 
 		//2560 bytes
 		for (i = 0; i < 128; i++) {
-			n_result = tasdevice_dev_read(tas_dev,
+			n_result = tasdevice_dev_read_nocache(tas_dev,
 				pSysCmd->mnCurrentChannel,
 				TASDEVICE_REG(pSysCmd->mnBook,
 				pSysCmd->mnPage, i), &data);
@@ -551,7 +550,7 @@ ssize_t regbininfo_list_show(struct device *dev,
 {
 	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
 	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
-	struct tasdevice_config_info **cfg_info = regbin->cfg_info;
+	struct tasdevice_config_info **cfg_info;
 	int n = 0, i = 0;
 
 	if (tas_dev == NULL) {
@@ -567,6 +566,8 @@ ssize_t regbininfo_list_show(struct device *dev,
 		return n;
 	}
 	mutex_lock(&tas_dev->codec_lock);
+	/* A regbin reload swaps cfg_info under codec_lock */
+	cfg_info = regbin->cfg_info;
 	if (n + 128 < PAGE_SIZE) {
 		n  += scnprintf(buf + n, PAGE_SIZE  - n,
 			"Regbin File Version: 0x%04X ",
@@ -675,11 +676,12 @@ ssize_t regcfg_list_show(struct device *dev,
 	if (tas_dev != NULL) {
 		struct Tsyscmd *pSysCmd = &tas_dev->nSysCmd[RegCfgListCmd];
 		struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
-		struct tasdevice_config_info **cfg_info = regbin->cfg_info;
+		struct tasdevice_config_info **cfg_info;
 
 		mutex_lock(&tas_dev->codec_lock);
+		cfg_info = regbin->cfg_info;
 		if (pSysCmd->bCmdErr == true ||
-			pSysCmd->mnPage >= regbin->ncfgs) {
+			!tasdevice_config_get(tas_dev, pSysCmd->mnPage)) {
 			len  += scnprintf(buf, pSysCmd->bufLen,
 				gSysCmdLog[RegCfgListCmd]);
 			goto out;
@@ -720,7 +722,7 @@ ssize_t regcfg_list_show(struct device *dev,
 					cfg_info[pSysCmd->mnPage]->
 						blk_data[j]->regdata
 						 +  length,
-					cfg_info[pSysCmd->mnBook]->
+					cfg_info[pSysCmd->mnPage]->
 						blk_data[j]->dev_idx,
 					cfg_info[pSysCmd->mnPage]->
 						blk_data[j]->block_size
@@ -828,3 +830,154 @@ ssize_t force_fw_load_chip_show(struct device *dev,
 
 	return n;
 }
+
+ssize_t saved_xfers_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int n = 0;
+
+	if (tas_dev != NULL)
+		n = scnprintf(buf, 32, "%ld\n",
+			atomic_long_read(&tas_dev->saved_xfers));
+	return n;
+}
+
+/* Any write clears the counter */
+ssize_t saved_xfers_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+
+	if (tas_dev != NULL)
+		atomic_long_set(&tas_dev->saved_xfers, 0);
+	return count;
+}
+
+ssize_t shadow_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int n = 0;
+
+	if (tas_dev != NULL)
+		n = scnprintf(buf, 64, "hits: %ld\nmisses: %ld\n",
+			atomic_long_read(&tas_dev->shadow_hits),
+			atomic_long_read(&tas_dev->shadow_misses));
+	return n;
+}
+
+/* Any write clears both counters */
+ssize_t shadow_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+
+	if (tas_dev != NULL) {
+		atomic_long_set(&tas_dev->shadow_hits, 0);
+		atomic_long_set(&tas_dev->shadow_misses, 0);
+	}
+	return count;
+}
+
+ssize_t force_full_write_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int n = 0;
+
+	if (tas_dev != NULL)
+		n = scnprintf(buf, 16, "%d\n", tas_dev->force_full_write);
+	return n;
+}
+
+/*
+ * 1: write every register even if the cache says it is unchanged. A
+ * debug knob for ruling the shadow out, not needed for correctness.
+ */
+ssize_t force_full_write_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	bool enable;
+	int ret;
+
+	if (tas_dev == NULL)
+		return count;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret) {
+		dev_err(tas_dev->dev, "%s: input error\n", __func__);
+		return ret;
+	}
+	mutex_lock(&tas_dev->dev_lock);
+	tas_dev->force_full_write = enable;
+	mutex_unlock(&tas_dev->dev_lock);
+	return count;
+}
+
+/* Retry/circuit-breaker counters per channel, "glb" is broadcast */
+ssize_t bus_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	struct tasdevice_bus_stats *stats;
+	int n = 0, i = 0;
+
+	if (tas_dev == NULL)
+		return 0;
+
+	n += scnprintf(buf + n, PAGE_SIZE - n,
+		"chn\taddr\tretries\tfailures\ttrips\tfastfails\n");
+	for (i = 0; i <= tas_dev->ndev; i++) {
+		if (!tas_dev->tasdevice[i].regmap)
+			continue;
+		stats = &tas_dev->tasdevice[i].bus_stats;
+		mutex_lock(tasdevice_chn_lock(tas_dev, i));
+		if (i == tas_dev->ndev)
+			n += scnprintf(buf + n, PAGE_SIZE - n, "glb\t");
+		else
+			n += scnprintf(buf + n, PAGE_SIZE - n, "%d\t", i);
+		n += scnprintf(buf + n, PAGE_SIZE - n,
+			"0x%02x\t%lu\t%lu\t\t%lu\t%lu\n",
+			tas_dev->tasdevice[i].mnDevAddr, stats->retries,
+			stats->failures, stats->breaker_trips,
+			stats->fast_fails);
+		mutex_unlock(tasdevice_chn_lock(tas_dev, i));
+	}
+	return n;
+}
+
+/* Any write clears the counters and closes all breakers */
+ssize_t bus_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int i = 0;
+
+	if (tas_dev == NULL)
+		return count;
+
+	for (i = 0; i <= tas_dev->ndev; i++) {
+		mutex_lock(tasdevice_chn_lock(tas_dev, i));
+		memset(&tas_dev->tasdevice[i].bus_stats, 0,
+			sizeof(tas_dev->tasdevice[i].bus_stats));
+		tas_dev->tasdevice[i].consec_fail = 0;
+		mutex_unlock(tasdevice_chn_lock(tas_dev, i));
+	}
+	return count;
+}
+
+/* Write anything to load *-reg.bin again, see tasdevice_regbin_reload() */
+ssize_t regbin_reload_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tasdevice_priv *tas_dev = dev_get_drvdata(dev);
+	int ret;
+
+	if (tas_dev == NULL)
+		return count;
+
+	ret = tasdevice_regbin_reload(tas_dev);
+	return ret ? ret : count;
+}
@@ -42,4 +42,22 @@ ssize_t force_fw_load_chip_show(struct device *dev,
 				struct device_attribute *attr, char *buf);
 ssize_t force_fw_load_chip_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count);
+ssize_t saved_xfers_show(struct device *dev,
+	struct device_attribute *attr, char *buf);
+ssize_t saved_xfers_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count);
+ssize_t shadow_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf);
+ssize_t shadow_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count);
+ssize_t force_full_write_show(struct device *dev,
+	struct device_attribute *attr, char *buf);
+ssize_t force_full_write_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count);
+ssize_t bus_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf);
+ssize_t bus_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count);
+ssize_t regbin_reload_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count);
 #endif
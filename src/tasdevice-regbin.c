@@ -18,9 +18,12 @@
 #include <linux/firmware.h>
 #include <linux/interrupt.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
 #include <linux/of_gpio.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #ifdef CONFIG_TASDEV_CODEC_SPI
 	#include <linux/spi/spi.h>
 #else
@@ -32,6 +35,7 @@
 #include "tasdevice.h"
 #include "tasdevice-codec.h"
 #include "tasdevice-rw.h"
+#include "tasdevice-trace.h"
 
 const char *blocktype[5] = {
 	"COEFF",
@@ -51,7 +55,7 @@ int tasdevice_process_block(void *pContext,
 	int chn = 0, chnend = 0;
 	int rc = 0;
 	int blktyp = dev_idx & 0xC0, idx = dev_idx & 0x3F;
-	bool bError = false;
+	bool bError = false, bDelayed = false;
 
 	if (idx) {
 		chn = idx-1;
@@ -70,12 +74,20 @@ int tasdevice_process_block(void *pContext,
 		if (tas_dev->set_global_mode == NULL &&
 			tas_dev->tasdevice[chn].bLoading == false)
 			continue;
+		if (!tasdevice_chn_mine(tas_dev, chn))
+			continue;
 
 		bError = false;
 		subblk_offset = 2;
+		rc = tasdevice_session_begin_preempt(tas_dev, chn);
+		if (rc < 0) {
+			bError = true;
+			goto err;
+		}
 		switch (subblk_typ) {
 		case TASDEVICE_CMD_SING_W: {
-			int i = 0;
+			struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+			int i = 0, n = 0;
 			unsigned short len = get_unaligned_be16(&data[2]);
 
 			subblk_offset  += 2;
@@ -87,17 +99,22 @@ int tasdevice_process_block(void *pContext,
 			}
 
 			for (i = 0; i < len; i++) {
-				rc = tasdevice_dev_write(tas_dev, chn,
-					TASDEVICE_REG(data[subblk_offset],
-						data[subblk_offset + 1],
-						data[subblk_offset + 2]),
-					data[subblk_offset + 3]);
+				seq[n].reg = TASDEVICE_REG(data[subblk_offset],
+					data[subblk_offset + 1],
+					data[subblk_offset + 2]);
+				seq[n].def = data[subblk_offset + 3];
+				seq[n].delay_us = 0;
+				subblk_offset  += 4;
+				if (++n < TASDEVICE_SEQ_CHUNK && i != len - 1)
+					continue;
+				rc = tasdevice_dev_multi_write(tas_dev, chn,
+					seq, n);
 				if (rc < 0) {
 					bError = true;
 					dev_err(tas_dev->dev,
 						"process_block: single write error\n");
 				}
-				subblk_offset  += 4;
+				n = 0;
 			}
 		}
 			break;
@@ -141,8 +158,19 @@ int tasdevice_process_block(void *pContext,
 				break;
 			}
 			delay_time = get_unaligned_be16(&data[2]);
-			usleep_range(delay_time*1000, delay_time*1000);
 			subblk_offset  += 2;
+			/* Waited once for all the channels of the sub-block */
+			if (bDelayed)
+				break;
+			bDelayed = true;
+			/* Nobody else needs to wait for the bus meanwhile */
+			tasdevice_session_end(tas_dev, chn);
+			tasdevice_delay_ms(delay_time);
+			rc = tasdevice_session_begin_preempt(tas_dev, chn);
+			if (rc < 0) {
+				bError = true;
+				goto err;
+			}
 		}
 			break;
 		case TASDEVICE_CMD_FIELD_W:
@@ -152,12 +180,22 @@ int tasdevice_process_block(void *pContext,
 			bError = true;
 			break;
 		}
-		rc = tasdevice_dev_update_bits(tas_dev, chn,
-			TASDEVICE_REG(data[subblk_offset + 2],
-				data[subblk_offset + 3],
-				data[subblk_offset + 4]),
-				data[subblk_offset + 1],
-				data[subblk_offset + 5]);
+		/* A full-byte mask needs no read-modify-write */
+		if (data[subblk_offset + 1] == 0xff) {
+			rc = tasdevice_dev_write(tas_dev, chn,
+				TASDEVICE_REG(data[subblk_offset + 2],
+					data[subblk_offset + 3],
+					data[subblk_offset + 4]),
+					data[subblk_offset + 5]);
+			if (rc >= 0)
+				atomic_long_inc(&tas_dev->saved_xfers);
+		} else
+			rc = tasdevice_dev_update_bits(tas_dev, chn,
+				TASDEVICE_REG(data[subblk_offset + 2],
+					data[subblk_offset + 3],
+					data[subblk_offset + 4]),
+					data[subblk_offset + 1],
+					data[subblk_offset + 5]);
 		if (rc < 0) {
 			bError = true;
 			dev_err(tas_dev->dev,
@@ -168,6 +206,8 @@ int tasdevice_process_block(void *pContext,
 		default:
 			break;
 		};
+		tasdevice_session_end(tas_dev, chn);
+err:
 		if (bError == true && blktyp != 0) {
 			tas_dev->tasdevice[chn].bLoaderr = true;
 			if (blktyp == 0x80) {
@@ -181,6 +221,363 @@ int tasdevice_process_block(void *pContext,
 	return subblk_offset;
 }
 
+/* Selectors and the software reset: writes whose order matters */
+static bool tasdevice_reg_is_ctl(unsigned int reg)
+{
+	return TASDEVICE_PAGE_REG(reg) == TASDEVICE_PAGE_SELECT ||
+		(TASDEVICE_PAGE_ID(reg) == TASDEVICE_BOOKCTL_PAGE &&
+		TASDEVICE_PAGE_REG(reg) == TASDEVICE_BOOKCTL_REG) ||
+		reg == TASDEVICE_REG_SWRESET;
+}
+
+/*
+ * Walk the sub-blocks of a regbin block once, with the same framing
+ * tasdevice_process_block() uses. With ops NULL only count what the
+ * block needs; otherwise fill in ops and seqs. Returns -EINVAL if the
+ * sub-blocks do not add up to exactly block_size. Also sets nwrites
+ * and bStatic, see tasdevice_build_image().
+ */
+static int tasdevice_parse_blk(struct tasdevice_block_data *blk,
+	struct tasdevice_blk_op *ops, struct reg_sequence *seqs,
+	unsigned int *nops, unsigned int *nseqs)
+{
+	unsigned char *data = blk->regdata;
+	unsigned int size = blk->block_size, offset = 0;
+	unsigned int n_op = 0, n_seq = 0, k, i, len, run;
+	unsigned int reg, run_reg = 0;
+	struct tasdevice_blk_op *op = NULL;
+
+	blk->nwrites = 0;
+	blk->bStatic = true;
+	for (k = 0; k < blk->nSublocks; k++) {
+		if (offset + 2 > size)
+			return -EINVAL;
+		data = blk->regdata + offset;
+		switch (data[1]) {
+		case TASDEVICE_CMD_SING_W:
+			if (offset + 4 > size)
+				return -EINVAL;
+			len = get_unaligned_be16(&data[2]);
+			if (offset + 4 + 4 * len > size)
+				return -EINVAL;
+			run = 0;
+			for (i = 0; i < len; i++) {
+				reg = TASDEVICE_REG(data[4 + 4 * i],
+					data[5 + 4 * i], data[6 + 4 * i]);
+				if (tasdevice_reg_is_ctl(reg))
+					blk->bStatic = false;
+				/* New run on a page change or a full chunk */
+				if (!run || run == TASDEVICE_SEQ_CHUNK ||
+					(run_reg & ~0x7f) != (reg & ~0x7f)) {
+					run = 0;
+					run_reg = reg;
+					if (ops) {
+						op = &ops[n_op];
+						op->cmd = TASDEVICE_CMD_SING_W;
+						op->reg = reg;
+						op->len = 0;
+						op->seq = &seqs[n_seq];
+					}
+					n_op++;
+				}
+				if (ops) {
+					op->seq[run].reg = reg;
+					op->seq[run].def = data[7 + 4 * i];
+					op->seq[run].delay_us = 0;
+					op->len++;
+				}
+				run++;
+				n_seq++;
+			}
+			blk->nwrites += len;
+			offset += 4 + 4 * len;
+			break;
+		case TASDEVICE_CMD_BURST:
+			if (offset + 4 > size)
+				return -EINVAL;
+			len = get_unaligned_be16(&data[2]);
+			if (offset + 8 + len > size || len % 4)
+				return -EINVAL;
+			reg = TASDEVICE_REG(data[4], data[5], data[6]);
+			for (i = 0; i < len; i++)
+				if (tasdevice_reg_is_ctl(reg + i))
+					blk->bStatic = false;
+			blk->nwrites += len;
+			if (ops) {
+				op = &ops[n_op];
+				op->cmd = TASDEVICE_CMD_BURST;
+				op->reg = reg;
+				op->len = len;
+				op->data = &data[8];
+			}
+			n_op++;
+			offset += 8 + len;
+			break;
+		case TASDEVICE_CMD_DELAY:
+			if (offset + 4 > size)
+				return -EINVAL;
+			blk->bStatic = false;
+			if (ops) {
+				op = &ops[n_op];
+				op->cmd = TASDEVICE_CMD_DELAY;
+				op->len = get_unaligned_be16(&data[2]);
+			}
+			n_op++;
+			offset += 4;
+			break;
+		case TASDEVICE_CMD_FIELD_W:
+			if (offset + 8 > size)
+				return -EINVAL;
+			reg = TASDEVICE_REG(data[4], data[5], data[6]);
+			if (data[3] != 0xff || tasdevice_reg_is_ctl(reg))
+				blk->bStatic = false;
+			blk->nwrites++;
+			if (ops) {
+				op = &ops[n_op];
+				op->cmd = TASDEVICE_CMD_FIELD_W;
+				op->mask = data[3];
+				op->reg = reg;
+				op->val = data[7];
+			}
+			n_op++;
+			offset += 8;
+			break;
+		default:
+			/* Unknown commands are skipped, header only */
+			blk->bStatic = false;
+			offset += 2;
+			break;
+		}
+	}
+	if (offset != size)
+		return -EINVAL;
+
+	*nops = n_op;
+	*nseqs = n_seq;
+	return 0;
+}
+
+/*
+ * All parsed regbin data (config and block structs, payloads and the
+ * compiled ops) lives in one allocation per regbin. tasdevice_regbin_need()
+ * sizes it in a first pass over the file, tasdevice_arena_take() then
+ * hands out consecutive pieces of it.
+ */
+struct tasdevice_arena {
+	unsigned char *base;
+	size_t used;
+	size_t size;
+};
+
+#define TASDEVICE_ARENA_SZ(sz)	ALIGN((size_t)(sz), sizeof(long))
+
+static void *tasdevice_arena_take(struct tasdevice_arena *arena,
+	size_t size)
+{
+	void *p;
+
+	size = TASDEVICE_ARENA_SZ(size);
+	if (arena->used + size > arena->size)
+		return NULL;
+	p = arena->base + arena->used;
+	arena->used += size;
+	return p;
+}
+
+/* Arena space the compiled ops of a block take, 0 if malformed */
+static size_t tasdevice_compile_need(struct tasdevice_block_data *blk)
+{
+	unsigned int nops = 0, nseqs = 0;
+
+	if (tasdevice_parse_blk(blk, NULL, NULL, &nops, &nseqs) < 0)
+		return 0;
+	return TASDEVICE_ARENA_SZ(max(nops, 1U) * sizeof(*blk->ops)) +
+		TASDEVICE_ARENA_SZ(nseqs * sizeof(*blk->seqs));
+}
+
+/*
+ * Decode a block into ops at load time, so applying a profile is a walk
+ * over a flat array with no parsing and no bounds checks left.
+ */
+static int tasdevice_compile_blk(struct tasdevice_priv *tas_dev,
+	struct tasdevice_block_data *blk, struct tasdevice_arena *arena)
+{
+	unsigned int nops = 0, nseqs = 0;
+	int ret;
+
+	ret = tasdevice_parse_blk(blk, NULL, NULL, &nops, &nseqs);
+	if (ret < 0) {
+		dev_err(tas_dev->dev, "%s: block type %u dev_idx 0x%02x is "
+			"malformed\n", __func__, blk->block_type, blk->dev_idx);
+		goto out;
+	}
+
+	blk->ops = tasdevice_arena_take(arena,
+		max(nops, 1U) * sizeof(*blk->ops));
+	blk->seqs = tasdevice_arena_take(arena, nseqs * sizeof(*blk->seqs));
+	if (!blk->ops || !blk->seqs) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ret = tasdevice_parse_blk(blk, blk->ops, blk->seqs, &nops, &nseqs);
+	if (ret < 0)
+		goto err;
+	blk->nops = nops;
+	goto out;
+err:
+	blk->ops = NULL;
+	blk->seqs = NULL;
+out:
+	return ret;
+}
+
+static int tasdevice_run_op(struct tasdevice_priv *tas_dev,
+	unsigned short chn, const struct tasdevice_blk_op *op)
+{
+	int rc = 0;
+
+	switch (op->cmd) {
+	case TASDEVICE_CMD_SING_W:
+		rc = tasdevice_dev_multi_write(tas_dev, chn, op->seq,
+			op->len);
+		break;
+	case TASDEVICE_CMD_BURST:
+		rc = tasdevice_dev_bulk_write(tas_dev, chn, op->reg,
+			op->data, op->len);
+		break;
+	case TASDEVICE_CMD_DELAY:
+		tasdevice_delay_ms(op->len);
+		break;
+	case TASDEVICE_CMD_FIELD_W:
+		/* A full-byte mask needs no read-modify-write */
+		if (op->mask == 0xff) {
+			rc = tasdevice_dev_write(tas_dev, chn, op->reg,
+				op->val);
+			if (rc >= 0)
+				atomic_long_inc(&tas_dev->saved_xfers);
+		} else
+			rc = tasdevice_dev_update_bits(tas_dev, chn, op->reg,
+				op->mask, op->val);
+		break;
+	}
+	if (rc < 0)
+		dev_err(tas_dev->dev, "%s: cmd %u B0x%02x P0x%02x R0x%02x "
+			"error = %d\n", __func__, op->cmd,
+			TASDEVICE_BOOK_ID(op->reg), TASDEVICE_PAGE_ID(op->reg),
+			TASDEVICE_PAGE_REG(op->reg), rc);
+	return rc;
+}
+
+/* Where one amp is in a compiled block while tasdevice_apply_blk runs */
+struct tasdevice_blk_seq {
+	unsigned short chn;
+	unsigned int pc;
+	ktime_t due;
+};
+
+/* Run seq's ops up to its next delay in one preemptible session */
+static int tasdevice_seq_step(struct tasdevice_priv *tas_dev,
+	struct tasdevice_block_data *blk, struct tasdevice_blk_seq *seq)
+{
+	const struct tasdevice_blk_op *op;
+	int ret = 0, rc;
+
+	if (blk->ops[seq->pc].cmd != TASDEVICE_CMD_DELAY) {
+		ret = tasdevice_session_begin_preempt(tas_dev, seq->chn);
+		if (ret < 0) {
+			seq->pc = blk->nops;
+			goto out;
+		}
+		for (; seq->pc < blk->nops; seq->pc++) {
+			op = &blk->ops[seq->pc];
+			if (op->cmd == TASDEVICE_CMD_DELAY)
+				break;
+			rc = tasdevice_run_op(tas_dev, seq->chn, op);
+			if (rc < 0 && !ret)
+				ret = rc;
+		}
+		tasdevice_session_end(tas_dev, seq->chn);
+	}
+
+	/* The delay counts from this amp's last write, not anybody else's */
+	if (seq->pc < blk->nops) {
+		seq->due = ktime_add_ms(ktime_get(), blk->ops[seq->pc].len);
+		seq->pc++;
+	}
+out:
+	/* As tasdevice_process_block() reports a failed sub-block */
+	if (ret < 0)
+		tas_dev->tasdevice[seq->chn].bLoaderr = true;
+	return ret;
+}
+
+/*
+ * Apply a compiled block to dev_idx (0 for all, broadcast if there is
+ * one). Every target amp walks the block on its own: an amp that reaches
+ * a delay is parked until its deadline and the others carry on meanwhile,
+ * so N amps pay each delay about once and every amp still gets its full
+ * delay after its own writes. With nothing runnable, sleep on an hrtimer
+ * until the earliest deadline.
+ */
+static int tasdevice_apply_blk(struct tasdevice_priv *tas_dev,
+	struct tasdevice_block_data *blk, unsigned char dev_idx)
+{
+	struct tasdevice_blk_seq seqs[TASDEVICE_MAX_CHANNELS + 1];
+	int chn, chnend, n = 0, i, ret = 0, rc;
+	ktime_t now, next;
+	bool busy, ran;
+
+	if (!blk->ops) {
+		dev_err(tas_dev->dev, "%s: skip malformed block\n", __func__);
+		return -EINVAL;
+	}
+
+	if (dev_idx) {
+		chn = dev_idx - 1;
+		chnend = dev_idx;
+	} else if (tas_dev->set_global_mode) {
+		chn = tas_dev->ndev;
+		chnend = tas_dev->ndev + 1;
+	} else {
+		chn = 0;
+		chnend = tas_dev->ndev;
+	}
+
+	for (; chn < chnend; chn++) {
+		if (tas_dev->set_global_mode == NULL &&
+			tas_dev->tasdevice[chn].bLoading == false)
+			continue;
+		if (!tasdevice_chn_mine(tas_dev, chn))
+			continue;
+		seqs[n].chn = chn;
+		seqs[n].pc = 0;
+		seqs[n].due = 0;
+		n++;
+	}
+
+	do {
+		now = ktime_get();
+		next = KTIME_MAX;
+		busy = ran = false;
+		for (i = 0; i < n; i++) {
+			if (ktime_before(now, seqs[i].due)) {
+				next = min(next, seqs[i].due);
+				busy = true;
+				continue;
+			}
+			if (seqs[i].pc >= blk->nops)
+				continue;
+			rc = tasdevice_seq_step(tas_dev, blk, &seqs[i]);
+			if (rc < 0 && !ret)
+				ret = rc;
+			busy = ran = true;
+		}
+		if (busy && !ran)
+			tasdevice_delay_until(next);
+	} while (busy);
+	return ret;
+}
+
 int tasdevice_process_block_show(void *pContext,
 	unsigned char *data, unsigned char dev_idx,
 	int sublocksize, char *buf, ssize_t *length)
@@ -382,6 +779,7 @@ void tasdevice_powerup_regcfg_dev(void *pContext, unsigned char dev)
 	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
 	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
 	struct tasdevice_config_info **cfg_info = regbin->cfg_info;
+	struct tasdevice_block_data *blk;
 	int j = 0, k = 0, conf_no = 0;
 
 	if (dev >= tas_dev->ndev) {
@@ -400,6 +798,8 @@ void tasdevice_powerup_regcfg_dev(void *pContext, unsigned char dev)
 		dev_info(tas_dev->dev, "%s: profile_conf_id = %d\n",
 			__func__, conf_no);
 	}
+	if (!tasdevice_config_get(tas_dev, conf_no))
+		goto out;
 
 	for (k = 0; k < tas_dev->ndev; k++) {
 		tas_dev->tasdevice[k].bLoading = false;
@@ -407,54 +807,212 @@ void tasdevice_powerup_regcfg_dev(void *pContext, unsigned char dev)
 	}
 
 	for (j = 0; j < (int)cfg_info[conf_no]->real_nblocks; j++) {
-		unsigned int length = 0, rc = 0;
-
-		if (TASDEVICE_BIN_BLK_PRE_POWER_UP !=
-			cfg_info[conf_no]->blk_data[j]->block_type)
+		blk = cfg_info[conf_no]->blk_data[j];
+		if (TASDEVICE_BIN_BLK_PRE_POWER_UP != blk->block_type)
 			continue;
-		dev_info(tas_dev->dev, "%s: conf %d\n", __func__, conf_no);
 		dev_info(tas_dev->dev,
-			"%s: block type:%s\t device idx = 0x%02x\n", __func__,
-			blocktype[cfg_info[conf_no]->blk_data[j]->
-				block_type-1],
-			cfg_info[conf_no]->blk_data[j]->dev_idx);
-		if ((cfg_info[conf_no]->blk_data[j]->dev_idx != 0)
-			&& (cfg_info[conf_no]->blk_data[j]->
-				dev_idx-1 != dev)) {
+			"%s: conf %d block type:%s\t device idx = 0x%02x\n",
+			__func__, conf_no, blocktype[blk->block_type - 1],
+			blk->dev_idx);
+		if (blk->dev_idx != 0 && blk->dev_idx - 1 != dev) {
 			dev_info(tas_dev->dev, "%s: No device %u in conf %d\n",
 				__func__, dev, conf_no);
 			goto out;
 		}
 
 		tas_dev->tasdevice[dev].bLoading = true;
-		for (k = 0; k < (int)cfg_info[conf_no]->blk_data[j]->nSublocks;
-			k++) {
-			rc = tasdevice_process_block(tas_dev,
-				cfg_info[conf_no]->blk_data[j]->regdata +
-					length,
-				dev + 1,
-				cfg_info[conf_no]->blk_data[j]->block_size -
-					length);
-			length  += rc;
-			if (cfg_info[conf_no]->blk_data[j]->block_size <
-				length) {
-				dev_err(tas_dev->dev,
-					"%s: ERROR:%u %u out of memory\n",
-					__func__, length,
-					cfg_info[conf_no]->blk_data[j]->
-						block_size);
+		tas_dev->tasdevice[dev].mnAppliedRegConf = -1;
+		tasdevice_apply_blk(tas_dev, blk, dev + 1);
+	}
+out:
+	return;
+}
+
+struct tasdevice_cfg_blk_arg {
+	int conf_no;
+	unsigned char block_type;
+	/* PRE_POWER_UP by tasdevice_apply_delta() */
+	bool delta;
+};
+
+/*
+ * A chip whose PRE_POWER_UP image of profile "from" is known to be in
+ * place only needs the writes of "to" that differ from it. Registers
+ * both profiles set to the same value are still checked against the
+ * register cache, since e.g. a shutdown block or a control may have
+ * changed them in the meantime.
+ */
+static int tasdevice_apply_delta(struct tasdevice_priv *tas_dev,
+	unsigned short chn, struct tasdevice_config_info *from,
+	struct tasdevice_config_info *to)
+{
+	const struct reg_sequence *old = from->image[chn];
+	const struct reg_sequence *new = to->image[chn];
+	unsigned int nold = from->nimage[chn], nnew = to->nimage[chn];
+	struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+	unsigned int i, k = 0, m, n = 0, sent = 0;
+	int ret;
+
+	tas_dev->tasdevice[chn].bLoading = true;
+	ret = tasdevice_session_begin_preempt(tas_dev, chn);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < nnew; i++) {
+		/* Variants of a profile mostly keep the order, look on from
+		 * where the last match was
+		 */
+		for (m = 0; m < nold; m++) {
+			if (old[k].reg == new[i].reg)
 				break;
+			k = (k + 1 < nold) ? k + 1 : 0;
+		}
+		if (m < nold && old[k].def == new[i].def &&
+			tasdevice_dev_holds(tas_dev, chn, new[i].reg,
+			new[i].def))
+			continue;
+		seq[n++] = new[i];
+		if (n < TASDEVICE_SEQ_CHUNK)
+			continue;
+		ret = tasdevice_dev_multi_write(tas_dev, chn, seq, n);
+		if (ret < 0)
+			goto end;
+		sent += n;
+		n = 0;
+	}
+	if (n) {
+		ret = tasdevice_dev_multi_write(tas_dev, chn, seq, n);
+		sent += n;
+	}
+end:
+	tasdevice_session_end(tas_dev, chn);
+	dev_dbg(tas_dev->dev, "%s: chn %u, %u of %u regs\n", __func__, chn,
+		sent, nnew);
+out:
+	if (ret < 0) {
+		tas_dev->tasdevice[chn].bLoaderr = true;
+		dev_err(tas_dev->dev, "%s: chn %u, error = %d\n", __func__,
+			chn, ret);
+	}
+	return ret;
+}
+
+/* Every amp holds a known profile that can be moved to conf_no by delta */
+static bool tasdevice_delta_ok(struct tasdevice_priv *tas_dev, int conf_no)
+{
+	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
+	int i, from;
+
+	if (tas_dev->force_full_write ||
+		!regbin->cfg_info[conf_no]->real_nblocks)
+		return false;
+	for (i = 0; i < tas_dev->ndev; i++) {
+		from = tas_dev->tasdevice[i].mnAppliedRegConf;
+		if (from < 0 || from >= regbin->ncfgs ||
+			!regbin->cfg_info[from]->image[i] ||
+			!regbin->cfg_info[conf_no]->image[i])
+			return false;
+	}
+	return true;
+}
+
+/* Whether any amp a block with this dev_idx writes to is ours to do */
+static bool tasdevice_blk_mine(struct tasdevice_priv *tas_dev,
+	unsigned char dev_idx)
+{
+	int chn;
+
+	if (dev_idx)
+		return tasdevice_chn_mine(tas_dev, dev_idx - 1);
+	for (chn = 0; chn < tas_dev->ndev; chn++)
+		if (tasdevice_chn_mine(tas_dev, chn))
+			return true;
+	return false;
+}
+
+/* The blocks of one profile, per bus when the amps span several */
+static int tasdevice_select_cfg_blk_bus(struct tasdevice_priv *tas_dev,
+	void *arg)
+{
+	struct tasdevice_cfg_blk_arg *blk_arg = arg;
+	struct tasdevice_config_info **cfg_info = tas_dev->mtRegbin.cfg_info;
+	int conf_no = blk_arg->conf_no;
+	unsigned char block_type = blk_arg->block_type;
+	struct tasdevice_block_data *blk;
+	int j = 0, chn = 0, chnend = 0, ret = 0, rc;
+	unsigned char dev_idx = 0;
+
+	if (block_type > 5 || block_type < 2) {
+		dev_err(tas_dev->dev,
+			"ERROR!!!block_type should be in range from 2 to 5\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (blk_arg->delta) {
+		for (chn = 0; chn < tas_dev->ndev; chn++) {
+			if (!tasdevice_chn_mine(tas_dev, chn))
+				continue;
+			rc = tasdevice_apply_delta(tas_dev, chn, cfg_info[
+				tas_dev->tasdevice[chn].mnAppliedRegConf],
+				cfg_info[conf_no]);
+			if (rc < 0 && !ret)
+				ret = rc;
+		}
+		goto applied;
+	}
+
+	for (j = 0; j < (int)cfg_info[conf_no]->real_nblocks; j++) {
+		blk = cfg_info[conf_no]->blk_data[j];
+		if (block_type != blk->block_type)
+			continue;
+		if (!tasdevice_blk_mine(tas_dev, blk->dev_idx))
+			continue;
+		dev_info(tas_dev->dev, "select_cfg_blk: conf %d, "
+			"block type:%s\t device idx = 0x%02x\n",
+			conf_no, blocktype[blk->block_type - 1], blk->dev_idx);
+
+		/* Identical per-device copies go out once by broadcast */
+		dev_idx = blk->dev_idx;
+		if (tas_dev->set_global_mode) {
+			if (blk->bBcastDup)
+				continue;
+			if (blk->bBcast) {
+				/* An earlier block may have reset the chips */
+				tas_dev->set_global_mode(tas_dev);
+				dev_idx = 0;
 			}
 		}
-		if (length != cfg_info[conf_no]->blk_data[j]->block_size) {
-			dev_err(tas_dev->dev,
-				"%s: ERROR: %u %u size is not same\n",
-				__func__, length,
-				cfg_info[conf_no]->blk_data[j]->block_size);
+
+		if (dev_idx) {
+			chn = dev_idx - 1;
+			chnend = dev_idx;
+		} else {
+			chn = 0;
+			chnend = tas_dev->ndev;
 		}
+		for (; chn < chnend; chn++)
+			tas_dev->tasdevice[chn].bLoading = true;
+
+		trace_tasdevice_block_begin(block_type, dev_idx,
+			tas_dev->set_global_mode && blk->bBcast,
+			blk->block_size);
+		rc = tasdevice_apply_blk(tas_dev, blk, dev_idx);
+		trace_tasdevice_block_end(block_type, rc);
+		if (rc < 0 && !ret)
+			ret = rc;
+	}
+
+applied:
+	/* After a failure nothing is known, the next switch replays all */
+	if (block_type == TASDEVICE_BIN_BLK_PRE_POWER_UP) {
+		for (chn = 0; chn < tas_dev->ndev; chn++)
+			if (tasdevice_chn_mine(tas_dev, chn))
+				tas_dev->tasdevice[chn].mnAppliedRegConf =
+					ret ? -1 : conf_no;
 	}
 out:
-	return;
+	return ret;
 }
 
 void tasdevice_select_cfg_blk(void *pContext, int conf_no,
@@ -464,7 +1022,11 @@ void tasdevice_select_cfg_blk(void *pContext, int conf_no,
 		(struct tasdevice_priv *) pContext;
 	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
 	struct tasdevice_config_info **cfg_info = regbin->cfg_info;
-	int j = 0, k = 0, chn = 0, chnend = 0;
+	struct tasdevice_cfg_blk_arg blk_arg = {
+		.conf_no = conf_no,
+		.block_type = block_type,
+	};
+	int ret = 0;
 
 	dev_err(tas_dev->dev, "%s, enter\n", __func__);
 	if (conf_no >= regbin->ncfgs || conf_no < 0 || NULL == cfg_info) {
@@ -477,83 +1039,256 @@ void tasdevice_select_cfg_blk(void *pContext, int conf_no,
 			"select_cfg_blk: profile_conf_id = %d\n",
 			conf_no);
 	}
+	if (!tasdevice_config_get(tas_dev, conf_no))
+		goto out;
+	trace_tasdevice_load_begin(TASDEVICE_LOAD_REGBIN_CFG, conf_no);
 
-	for (j = 0; j < (int)cfg_info[conf_no]->real_nblocks; j++) {
-		unsigned int length = 0, rc = 0;
+	if (block_type == TASDEVICE_BIN_BLK_PRE_POWER_UP &&
+		tasdevice_delta_ok(tas_dev, conf_no)) {
+		blk_arg.delta = true;
+		dev_info(tas_dev->dev, "select_cfg_blk: profile %d by delta\n",
+			conf_no);
+	}
+	ret = tasdevice_bus_parallel(tas_dev, tasdevice_select_cfg_blk_bus,
+		&blk_arg);
 
-		if (block_type > 5 || block_type < 2) {
-			dev_err(tas_dev->dev,
-				"ERROR!!!block_type should be in range from 2 "
-				"to 5\n");
-			goto out;
+	trace_tasdevice_load_end(TASDEVICE_LOAD_REGBIN_CFG, conf_no, ret);
+out:
+	return;
+}
+
+/* A software reset drops the global address mode of the chips */
+static bool tasdevice_blk_resets(struct tasdevice_block_data *blk)
+{
+	const struct tasdevice_blk_op *op;
+	unsigned int i, k;
+
+	for (i = 0; i < blk->nops; i++) {
+		op = &blk->ops[i];
+		switch (op->cmd) {
+		case TASDEVICE_CMD_SING_W:
+			for (k = 0; k < op->len; k++)
+				if (op->seq[k].reg == TASDEVICE_REG_SWRESET)
+					return true;
+			break;
+		case TASDEVICE_CMD_BURST:
+			if (op->reg <= TASDEVICE_REG_SWRESET &&
+				op->reg + op->len > TASDEVICE_REG_SWRESET)
+				return true;
+			break;
+		case TASDEVICE_CMD_FIELD_W:
+			if (op->reg == TASDEVICE_REG_SWRESET)
+				return true;
+			break;
 		}
-		if (block_type != cfg_info[conf_no]->blk_data[j]->block_type)
+	}
+	return false;
+}
+
+static bool tasdevice_blk_same(struct tasdevice_block_data *a,
+	struct tasdevice_block_data *b)
+{
+	return a->block_type == b->block_type &&
+		a->block_size == b->block_size &&
+		a->nSublocks == b->nSublocks &&
+		!memcmp(a->regdata, b->regdata, a->block_size);
+}
+
+/*
+ * Mark per-device blocks of a profile whose data is the same for every
+ * device, the first copy then goes through the broadcast address and
+ * the others are skipped. Only blocks of the same type run together,
+ * and a copy is folded only when no block of that type in between
+ * touches its device, so each chip still sees its writes in order.
+ * Malformed blocks and blocks with a software reset are never grouped,
+ * the writes after the reset would go to an address nobody answers.
+ */
+static void tasdevice_find_bcast_blk(struct tasdevice_priv *tas_dev,
+	struct tasdevice_config_info *cfg_info)
+{
+	struct tasdevice_block_data **blk = cfg_info->blk_data;
+	unsigned int all = GENMASK(tas_dev->ndev - 1, 0);
+	unsigned int dup[TASDEVICE_MAX_CHANNELS];
+	unsigned int mask, touched;
+	int i, j, dev, lead_dev;
+
+	if (tas_dev->ndev < 2)
+		return;
+
+	for (i = 0; i < (int)cfg_info->real_nblocks; i++) {
+		lead_dev = blk[i]->dev_idx - 1;
+		if (blk[i]->bBcastDup || lead_dev < 0 ||
+			lead_dev >= tas_dev->ndev || !blk[i]->ops ||
+			tasdevice_blk_resets(blk[i]))
 			continue;
-		dev_info(tas_dev->dev, "select_cfg_blk: conf %d, "
-			"block type:%s\t device idx = 0x%02x\n",
-			conf_no, blocktype[cfg_info[conf_no]->blk_data[j]
-			->block_type-1], cfg_info[conf_no]->blk_data[j]
-			->dev_idx);
-
-		for (k = 0; k < (int)cfg_info[conf_no]->blk_data[j]
-			->nSublocks; k++) {
-			if (cfg_info[conf_no]->blk_data[j]->dev_idx) {
-				chn = cfg_info[conf_no]->blk_data[j]->dev_idx-1;
-				chnend = cfg_info[conf_no]->blk_data[j]->dev_idx;
-			} else {
-				chn = 0;
-				chnend = tas_dev->ndev;
-			}
-			for (; chn < chnend; chn++) {
-				tas_dev->tasdevice[chn].bLoading = true;
-			}
-			rc = tasdevice_process_block(tas_dev,
-				cfg_info[conf_no]->blk_data[j]->regdata +
-					length,
-				cfg_info[conf_no]->blk_data[j]->dev_idx,
-				cfg_info[conf_no]->blk_data[j]->block_size -
-					length);
-			length  += rc;
-			if (cfg_info[conf_no]->blk_data[j]->block_size <
-				length) {
-				dev_err(tas_dev->dev, "select_cfg_blk: "
-					"ERROR:%u %u out of memory\n", length,
-					cfg_info[conf_no]->blk_data[j]->
-						block_size);
+
+		mask = BIT(lead_dev);
+		touched = 0;
+		for (j = i + 1; j < (int)cfg_info->real_nblocks &&
+			mask != all; j++) {
+			if (blk[j]->block_type != blk[i]->block_type)
+				continue;
+			dev = blk[j]->dev_idx - 1;
+			if (dev < 0 || dev >= tas_dev->ndev)
 				break;
-			}
+			if (!blk[j]->bBcastDup &&
+				!((mask | touched) & BIT(dev)) &&
+				tasdevice_blk_same(blk[i], blk[j])) {
+				mask |= BIT(dev);
+				dup[dev] = j;
+			} else
+				touched |= BIT(dev);
 		}
-		if (length != cfg_info[conf_no]->blk_data[j]->block_size) {
-			dev_err(tas_dev->dev,
-				"select_cfg_blk: ERROR: %u %u size is not "
-				"same\n", length,
-				cfg_info[conf_no]->blk_data[j]->block_size);
+		if (mask != all)
+			continue;
+
+		blk[i]->bBcast = true;
+		for (dev = 0; dev < tas_dev->ndev; dev++) {
+			if (dev != lead_dev)
+				blk[dup[dev]]->bBcastDup = true;
 		}
+		dev_info(tas_dev->dev, "%s: %s block %d goes out by "
+			"broadcast\n", __func__, cfg_info->mpName, i);
 	}
+}
 
-out:
-	return;
+static int tasdevice_reg_cmp(const void *a, const void *b)
+{
+	unsigned int ra = *(const unsigned int *)a;
+	unsigned int rb = *(const unsigned int *)b;
+
+	return ra < rb ? -1 : ra > rb;
 }
 
-static struct tasdevice_config_info *tasdevice_add_config(
-	void *pContext, unsigned char *config_data,
+/*
+ * Flatten the PRE_POWER_UP writes that reach dev into one list, in the
+ * order they go out. Only done when every such block is static and no
+ * register is written twice, so the list alone says what the chip ends
+ * up with and any subset of it may be sent in the same order.
+ */
+static void tasdevice_build_image(struct tasdevice_priv *tas_dev,
+	struct tasdevice_config_info *cfg_info, int dev,
+	struct tasdevice_arena *arena)
+{
+	struct tasdevice_block_data *blk;
+	struct tasdevice_blk_op *op;
+	struct reg_sequence *img;
+	unsigned int total = 0, n = 0, i, j, k;
+	unsigned int *regs;
+
+	for (j = 0; j < cfg_info->real_nblocks; j++) {
+		blk = cfg_info->blk_data[j];
+		if (blk->block_type != TASDEVICE_BIN_BLK_PRE_POWER_UP ||
+			(blk->dev_idx && blk->dev_idx - 1 != dev))
+			continue;
+		if (!blk->ops || !blk->bStatic)
+			return;
+		total += blk->nwrites;
+	}
+	img = tasdevice_arena_take(arena, total * sizeof(*img));
+	if (!img)
+		return;
+
+	for (j = 0; j < cfg_info->real_nblocks; j++) {
+		blk = cfg_info->blk_data[j];
+		if (blk->block_type != TASDEVICE_BIN_BLK_PRE_POWER_UP ||
+			(blk->dev_idx && blk->dev_idx - 1 != dev))
+			continue;
+		for (i = 0; i < blk->nops; i++) {
+			op = &blk->ops[i];
+			if (op->cmd == TASDEVICE_CMD_SING_W) {
+				for (k = 0; k < op->len; k++)
+					img[n++] = op->seq[k];
+			} else if (op->cmd == TASDEVICE_CMD_BURST) {
+				for (k = 0; k < op->len; k++) {
+					img[n].reg = op->reg + k;
+					img[n].def = op->data[k];
+					img[n++].delay_us = 0;
+				}
+			} else if (op->cmd == TASDEVICE_CMD_FIELD_W) {
+				img[n].reg = op->reg;
+				img[n].def = op->val;
+				img[n++].delay_us = 0;
+			}
+		}
+	}
+
+	/* Repeated registers show up next to each other in a sorted copy */
+	regs = kvmalloc_array(n, sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return;
+	for (i = 0; i < n; i++)
+		regs[i] = img[i].reg;
+	sort(regs, n, sizeof(*regs), tasdevice_reg_cmp, NULL);
+	for (i = 1; i < n; i++)
+		if (regs[i - 1] == regs[i])
+			break;
+	kvfree(regs);
+	if (i < n)
+		return;
+
+	cfg_info->image[dev] = img;
+	cfg_info->nimage[dev] = n;
+}
+
+/*
+ * Arena space the blocks of one config need, following the same steps
+ * (and stopping at the same truncation points) as tasdevice_add_config().
+ */
+static size_t tasdevice_config_need(struct tasdevice_priv *tas_dev,
+	struct tasdevice_regbin *regbin, unsigned char *config_data,
 	unsigned int config_size)
 {
-	struct tasdevice_priv *tas_dev =
-		(struct tasdevice_priv *)pContext;
-	struct tasdevice_config_info *cfg_info = NULL;
-	int config_offset = 0, i = 0;
+	struct tasdevice_block_data blk = { 0 };
+	unsigned int config_offset = 0, nblocks, i, ppu_writes = 0;
+	size_t need = 0;
 
-	cfg_info = kzalloc(
-			sizeof(struct tasdevice_config_info), GFP_KERNEL);
-	if (!cfg_info) {
-		dev_err(tas_dev->dev,
-			"add config: cfg_info alloc failed!\n");
+	if (regbin->fw_hdr.binary_version_num >= 0x105)
+		config_offset += 64;
+	if (config_offset + 4 > config_size)
 		goto out;
+	nblocks = get_unaligned_be32(&config_data[config_offset]);
+	config_offset += 4;
+	need += TASDEVICE_ARENA_SZ(nblocks *
+		sizeof(struct tasdevice_block_data *));
+
+	for (i = 0; i < nblocks; i++) {
+		if (config_offset + 12 > config_size)
+			break;
+		blk.block_type = config_data[config_offset + 1];
+		blk.block_size = get_unaligned_be32(
+			&config_data[config_offset + 4]);
+		blk.nSublocks = get_unaligned_be32(
+			&config_data[config_offset + 8]);
+		config_offset += 12;
+		need += TASDEVICE_ARENA_SZ(sizeof(blk));
+		if (config_offset + blk.block_size > config_size)
+			break;
+		blk.regdata = &config_data[config_offset];
+		need += tasdevice_compile_need(&blk);
+		if (blk.block_type == TASDEVICE_BIN_BLK_PRE_POWER_UP)
+			ppu_writes += blk.nwrites;
+		config_offset += blk.block_size;
 	}
+	need += tas_dev->ndev *
+		TASDEVICE_ARENA_SZ(ppu_writes * sizeof(struct reg_sequence));
+out:
+	return need;
+}
 
-	if (tas_dev->mtRegbin.fw_hdr.binary_version_num >= 0x105) {
-		if (config_offset + 64 > (int)config_size) {
+/*
+ * What is known of a config before it is parsed: name, block count and
+ * the devices its PRE_POWER_UP blocks go to, from the block headers.
+ */
+static void tasdevice_scan_config(struct tasdevice_priv *tas_dev,
+	struct tasdevice_regbin *regbin, struct tasdevice_config_info *cfg_info,
+	unsigned char *config_data, unsigned int config_size)
+{
+	unsigned int config_offset = 0, block_size, i;
+	unsigned char dev_idx;
+
+	if (regbin->fw_hdr.binary_version_num >= 0x105) {
+		if (config_offset + 64 > config_size) {
 			dev_err(tas_dev->dev,
 				"add config: Out of memory\n");
 			goto out;
@@ -562,7 +1297,7 @@ static struct tasdevice_config_info *tasdevice_add_config(
 		config_offset  += 64;
 	}
 
-	if (config_offset + 4 > (int)config_size) {
+	if (config_offset + 4 > config_size) {
 		dev_err(tas_dev->dev,
 			"add config: Out of memory\n");
 		goto out;
@@ -571,12 +1306,65 @@ static struct tasdevice_config_info *tasdevice_add_config(
 		get_unaligned_be32(&config_data[config_offset]);
 	config_offset  +=  4;
 
-	cfg_info->blk_data = kcalloc(
-		cfg_info->nblocks, sizeof(struct tasdevice_block_data *),
-		GFP_KERNEL);
+	for (i = 0; i < cfg_info->nblocks; i++) {
+		if (config_offset + 12 > config_size)
+			break;
+		dev_idx = config_data[config_offset];
+		if (config_data[config_offset + 1] ==
+			TASDEVICE_BIN_BLK_PRE_POWER_UP) {
+			if (0 == dev_idx)
+				cfg_info->active_dev = (1 << tas_dev->ndev) - 1;
+			else
+				cfg_info->active_dev |= (1 << (dev_idx - 1));
+		}
+		block_size = get_unaligned_be32(&config_data[config_offset + 4]);
+		config_offset  += 12;
+		if (config_offset + block_size > config_size)
+			break;
+		config_offset  += block_size;
+	}
+out:
+	return;
+}
+
+/* Parse the blocks of a scanned config into an arena of its own */
+static int tasdevice_add_config(struct tasdevice_priv *tas_dev,
+	struct tasdevice_regbin *regbin, struct tasdevice_config_info *cfg_info)
+{
+	struct tasdevice_arena arena = { 0 };
+	struct tasdevice_block_data *blk;
+	unsigned int config_size = cfg_info->size;
+	unsigned char *config_data;
+	int config_offset = 0, i = 0, ret = 0;
+
+	config_data = (unsigned char *)regbin->fw->data + cfg_info->offset;
+	arena.size = tasdevice_config_need(tas_dev, regbin, config_data,
+		config_size);
+	arena.base = kvzalloc(arena.size, GFP_KERNEL);
+	if (!arena.base) {
+		dev_err(tas_dev->dev, "add config: arena of %zu bytes alloc "
+			"failed!\n", arena.size);
+		ret = -ENOMEM;
+		goto out;
+	}
+	cfg_info->arena = arena.base;
+
+	if (regbin->fw_hdr.binary_version_num >= 0x105)
+		config_offset  += 64;
+	/* Truncated before the block count, scan said so already */
+	if (config_offset + 4 > (int)config_size)
+		goto out;
+	config_offset  +=  4;
+
+	cfg_info->blk_data = tasdevice_arena_take(&arena,
+		cfg_info->nblocks * sizeof(struct tasdevice_block_data *));
 	if (!cfg_info->blk_data) {
 		dev_err(tas_dev->dev,
 			"add config: blk_data alloc failed!\n");
+		/* Left unparsed, the next tasdevice_regbin_cfg() retries */
+		kvfree(arena.base);
+		cfg_info->arena = NULL;
+		ret = -ENOMEM;
 		goto out;
 	}
 	cfg_info->real_nblocks = 0;
@@ -587,89 +1375,121 @@ static struct tasdevice_config_info *tasdevice_add_config(
 				"%u!\n", i, cfg_info->nblocks);
 			break;
 		}
-		cfg_info->blk_data[i] = kzalloc(
-			sizeof(struct tasdevice_block_data), GFP_KERNEL);
-		if (!cfg_info->blk_data[i]) {
+		blk = tasdevice_arena_take(&arena, sizeof(*blk));
+		if (!blk) {
 			dev_err(tas_dev->dev,
 				"add config: blk_data[%d] alloc failed!\n", i);
 			break;
 		}
-		cfg_info->blk_data[i]->dev_idx = config_data[config_offset];
+		cfg_info->blk_data[i] = blk;
+		blk->dev_idx = config_data[config_offset];
 		config_offset++;
 
-		cfg_info->blk_data[i]->block_type = config_data[config_offset];
+		blk->block_type = config_data[config_offset];
 		config_offset++;
 
-		if (cfg_info->blk_data[i]->block_type  ==
-			TASDEVICE_BIN_BLK_PRE_POWER_UP) {
-			if (0 == cfg_info->blk_data[i]->dev_idx)
-				cfg_info->active_dev = (1 << tas_dev->ndev) - 1;
-			else
-				cfg_info->active_dev |= (1 << (cfg_info->blk_data[i]->dev_idx
-					- 1));
-		}
-		cfg_info->blk_data[i]->yram_checksum =
+		blk->yram_checksum =
 			get_unaligned_be16(&config_data[config_offset]);
 		config_offset  += 2;
-		cfg_info->blk_data[i]->block_size =
+		blk->block_size =
 			get_unaligned_be32(&config_data[config_offset]);
 		config_offset  += 4;
 
-		cfg_info->blk_data[i]->nSublocks =
+		blk->nSublocks =
 			get_unaligned_be32(&config_data[config_offset]);
-
 		config_offset  += 4;
-		cfg_info->blk_data[i]->regdata = kzalloc(
-			cfg_info->blk_data[i]->block_size, GFP_KERNEL);
-		if (!cfg_info->blk_data[i]->regdata) {
-			dev_err(tas_dev->dev,
-				"add config: regdata alloc failed!\n");
-			goto out;
-		}
-		if (config_offset + cfg_info->blk_data[i]->block_size
-			> config_size) {
+
+		if (config_offset + blk->block_size > config_size) {
 			dev_err(tas_dev->dev,
 				"add config: block_size Out of memory: "
 				"i = %d nblocks = %u!\n", i,
 				cfg_info->nblocks);
 			break;
 		}
-		memcpy(cfg_info->blk_data[i]->regdata,
-			&config_data[config_offset],
-		cfg_info->blk_data[i]->block_size);
-		config_offset  += cfg_info->blk_data[i]->block_size;
+		/* Read only from here on, no need for a copy */
+		blk->regdata = &config_data[config_offset];
+		config_offset  += blk->block_size;
 		cfg_info->real_nblocks  += 1;
+		/* A malformed block stays listed but is never sent */
+		tasdevice_compile_blk(tas_dev, blk, &arena);
 	}
+	tasdevice_find_bcast_blk(tas_dev, cfg_info);
+	for (i = 0; i < tas_dev->ndev; i++)
+		tasdevice_build_image(tas_dev, cfg_info, i, &arena);
 out:
-	return cfg_info;
+	return ret;
 }
 
-void tasdevice_regbin_ready(const struct firmware *pFW,
-	void *pContext)
+/* Config conf_no of regbin, parsing its blocks if not done yet */
+static struct tasdevice_config_info *tasdevice_regbin_cfg(
+	struct tasdevice_priv *tas_dev, struct tasdevice_regbin *regbin,
+	int conf_no)
+{
+	struct tasdevice_config_info *cfg_info;
+
+	if (conf_no >= regbin->ncfgs || conf_no < 0 || !regbin->cfg_info)
+		return NULL;
+	cfg_info = regbin->cfg_info[conf_no];
+	if (smp_load_acquire(&cfg_info->bParsed))
+		return cfg_info;
+
+	mutex_lock(&regbin->parse_lock);
+	if (!cfg_info->bParsed && regbin->fw &&
+		!tasdevice_add_config(tas_dev, regbin, cfg_info)) {
+		dev_info(tas_dev->dev, "%s: conf %d parsed\n", __func__,
+			conf_no);
+		smp_store_release(&cfg_info->bParsed, true);
+	}
+	mutex_unlock(&regbin->parse_lock);
+	return cfg_info->bParsed ? cfg_info : NULL;
+}
+
+/*
+ * Config conf_no with its blocks parsed, which happens the first time it
+ * is asked for. NULL if out of range or out of memory.
+ */
+struct tasdevice_config_info *tasdevice_config_get(void *pContext,
+	int conf_no)
 {
 	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+
+	return tasdevice_regbin_cfg(tas_dev, &tas_dev->mtRegbin, conf_no);
+}
+
+/* Configs the device tree wants parsed up front, "ti,regbin-preload" */
+static void tasdevice_config_preload(struct tasdevice_priv *tas_dev,
+	struct tasdevice_regbin *regbin)
+{
+	struct device_node *np = tas_dev->dev->of_node;
+	int i, n;
+	u32 conf_no;
+
+	n = of_property_count_u32_elems(np, "ti,regbin-preload");
+	for (i = 0; i < n; i++) {
+		if (of_property_read_u32_index(np, "ti,regbin-preload", i,
+			&conf_no))
+			break;
+		if (!tasdevice_regbin_cfg(tas_dev, regbin, conf_no))
+			dev_err(tas_dev->dev, "%s: conf %u not loaded\n",
+				__func__, conf_no);
+	}
+}
+
+/*
+ * Check the header of a regbin image and scan its configs into regbin,
+ * which takes pFW over on success. Nothing else of tas_dev is touched, so
+ * a reload can run this next to the image in use.
+ */
+static int tasdevice_regbin_parse(struct tasdevice_priv *tas_dev,
+	const struct firmware *pFW, struct tasdevice_regbin *regbin)
+{
+	struct tasdevice_regbin_hdr *fw_hdr = &(regbin->fw_hdr);
 	struct tasdevice_config_info **cfg_info;
-	struct tasdevice_regbin_hdr *fw_hdr;
-	struct tasdevice_regbin *regbin;
-	const struct firmware *fw_entry;
+	struct tasdevice_arena arena = { 0 };
 	unsigned int total_config_sz = 0;
 	int offset = 0, i, j, ret = 0;
 	unsigned char *buf = NULL;
 
-	if (tas_dev == NULL) {
-		dev_err(tas_dev->dev,
-			"tasdev: regbin_ready: handle is NULL\n");
-		return;
-	}
-	mutex_lock(&tas_dev->codec_lock);
-	regbin = &(tas_dev->mtRegbin);
-	fw_hdr = &(regbin->fw_hdr);
-	if (unlikely(!pFW) || unlikely(!pFW->data)) {
-		dev_err(tas_dev->dev, "Failed to read %s, no side - effect on "
-			"driver running\n", tas_dev->regbin_binaryname);
-		ret = -1;
-		goto out;
-	}
 	buf = (unsigned char *)pFW->data;
 
 	dev_info(tas_dev->dev, "tasdev: regbin_ready start\n");
@@ -739,25 +1559,41 @@ void tasdevice_regbin_ready(const struct firmware *pFW,
 		ret = -1;
 		goto out;
 	}
-	cfg_info = kcalloc(fw_hdr->nconfig, sizeof(struct tasdevice_config_info *),
-		GFP_KERNEL);
+	if (fw_hdr->nconfig > TASDEVICE_CONFIG_SUM) {
+		dev_err(tas_dev->dev, "nconfig %u is over %d\n",
+			fw_hdr->nconfig, TASDEVICE_CONFIG_SUM);
+		ret = -1;
+		goto out;
+	}
 
-	if (!cfg_info) {
+	/*
+	 * Only the headers of the configs are read here, their blocks are
+	 * parsed on first use out of the image, which is kept for that.
+	 */
+	arena.size = TASDEVICE_ARENA_SZ(fw_hdr->nconfig *
+		sizeof(struct tasdevice_config_info *)) + fw_hdr->nconfig *
+		TASDEVICE_ARENA_SZ(sizeof(struct tasdevice_config_info));
+	arena.base = kvzalloc(arena.size, GFP_KERNEL);
+	if (!arena.base) {
 		ret = -1;
-		dev_err(tas_dev->dev, "nconfig Memory alloc failed!\n");
+		dev_err(tas_dev->dev, "arena of %zu bytes alloc failed!\n",
+			arena.size);
 		goto out;
 	}
+	regbin->arena = arena.base;
+	regbin->fw = pFW;
+	cfg_info = tasdevice_arena_take(&arena,
+		fw_hdr->nconfig * sizeof(struct tasdevice_config_info *));
+
 	regbin->cfg_info = cfg_info;
 	regbin->ncfgs = 0;
 	for (i = 0; i < (int)fw_hdr->nconfig; i++) {
-		cfg_info[i] = tasdevice_add_config(pContext, &buf[offset],
-				fw_hdr->config_size[i]);
-		if (!cfg_info[i]) {
-			ret = -1;
-			dev_err(tas_dev->dev,
-				"add_config Memory alloc failed!\n");
-			break;
-		}
+		cfg_info[i] = tasdevice_arena_take(&arena,
+			sizeof(struct tasdevice_config_info));
+		cfg_info[i]->offset = offset;
+		cfg_info[i]->size = fw_hdr->config_size[i];
+		tasdevice_scan_config(tas_dev, regbin, cfg_info[i],
+			&buf[offset], fw_hdr->config_size[i]);
 		offset  += (int)fw_hdr->config_size[i];
 		regbin->ncfgs  += 1;
 	}
@@ -772,6 +1608,35 @@ void tasdevice_regbin_ready(const struct firmware *pFW,
 		}
 		regbin->direct_rotation_cfg_total = j;
 	}
+out:
+	return ret;
+}
+
+void tasdevice_regbin_ready(const struct firmware *pFW,
+	void *pContext)
+{
+	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+	const struct firmware *fw_entry;
+	int i, ret = 0;
+
+	if (tas_dev == NULL) {
+		dev_err(tas_dev->dev,
+			"tasdev: regbin_ready: handle is NULL\n");
+		return;
+	}
+	mutex_lock(&tas_dev->codec_lock);
+	trace_tasdevice_load_begin(TASDEVICE_LOAD_REGBIN, -1);
+	if (unlikely(!pFW) || unlikely(!pFW->data)) {
+		dev_err(tas_dev->dev, "Failed to read %s, no side - effect on "
+			"driver running\n", tas_dev->regbin_binaryname);
+		ret = -1;
+		goto out;
+	}
+	ret = tasdevice_regbin_parse(tas_dev, pFW, &tas_dev->mtRegbin);
+	if (ret)
+		goto out;
+	pFW = NULL;
+	tasdevice_config_preload(tas_dev, &tas_dev->mtRegbin);
 
 	tasdevice_create_controls(tas_dev);
 	tas_dev->fw_state = TASDEVICE_DSP_FW_ALL_OK;
@@ -794,8 +1659,7 @@ void tasdevice_regbin_ready(const struct firmware *pFW,
 	tasdevice_dsp_create_control(tas_dev);
 
 	for (i = 0; i < tas_dev->ndev; i++) {
-		scnprintf(tas_dev->cal_binaryname[i], 64, "%s-0x%02x-cal.bin",
-			tas_dev->dev_name, tas_dev->tasdevice[i].mnDevAddr);
+		tasdevice_cal_binaryname(tas_dev, i);
 		ret = tas2781_load_calibration(tas_dev,
 			tas_dev->cal_binaryname[i], i);
 		if (ret != 0) {
@@ -810,36 +1674,204 @@ void tasdevice_regbin_ready(const struct firmware *pFW,
 		tas_dev->cur_conf, 0);
 
 out:
+	trace_tasdevice_load_end(TASDEVICE_LOAD_REGBIN, -1, ret);
 	mutex_unlock(&tas_dev->codec_lock);
 	if (pFW)
 		release_firmware(pFW);
 	dev_info(tas_dev->dev, "Firmware init complete\n");
 }
 
+/* Drop the image and every config of regbin */
+static void tasdevice_regbin_free(struct tasdevice_regbin *regbin)
+{
+	int i;
+
+	for (i = 0; i < regbin->ncfgs; i++)
+		kvfree(regbin->cfg_info[i]->arena);
+	kvfree(regbin->arena);
+	regbin->arena = NULL;
+	regbin->cfg_info = NULL;
+	regbin->ncfgs = 0;
+	release_firmware(regbin->fw);
+	regbin->fw = NULL;
+}
+
+static void tasdevice_regbin_next_free(struct tasdevice_regbin *next)
+{
+	if (!next)
+		return;
+	tasdevice_regbin_free(next);
+	mutex_destroy(&next->parse_lock);
+	kfree(next);
+}
+
+/*
+ * Put a regbin staged by tasdevice_regbin_reload() in place of the one in
+ * use. Called with codec_lock held, when no stream is running or right
+ * before one starts, so the blocks of a profile never mix old and new.
+ */
+void tasdevice_regbin_swap(void *pContext)
+{
+	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
+	struct tasdevice_regbin *next = tas_dev->regbin_next;
+	int i;
+
+	if (!next)
+		return;
+	tas_dev->regbin_next = NULL;
+
+	mutex_lock(&tas_dev->dev_lock);
+	/* The delta images were those of the old regbin */
+	for (i = 0; i < tas_dev->ndev; i++)
+		tas_dev->tasdevice[i].mnAppliedRegConf = -1;
+	mutex_lock(&regbin->parse_lock);
+	tasdevice_regbin_free(regbin);
+	regbin->fw_hdr = next->fw_hdr;
+	regbin->cfg_info = next->cfg_info;
+	regbin->arena = next->arena;
+	regbin->fw = next->fw;
+	regbin->ncfgs = next->ncfgs;
+	regbin->direct_rotation_cfg_id = next->direct_rotation_cfg_id;
+	regbin->direct_rotation_cfg_total = next->direct_rotation_cfg_total;
+	mutex_unlock(&regbin->parse_lock);
+	mutex_unlock(&tas_dev->dev_lock);
+
+	next->cfg_info = NULL;
+	next->arena = NULL;
+	next->fw = NULL;
+	next->ncfgs = 0;
+	tasdevice_regbin_next_free(next);
+	dev_info(tas_dev->dev, "%s: %s in use\n", __func__,
+		tas_dev->regbin_binaryname);
+}
+
+/*
+ * A reloaded regbin is parsed and checked off to the side, while controls
+ * and streams keep using the old one. Its profile count has to match, the
+ * ALSA controls were sized for it, and the profile in use has to parse.
+ */
+static void tasdevice_regbin_reload_ready(const struct firmware *pFW,
+	void *pContext)
+{
+	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+	struct tasdevice_regbin *next = NULL;
+	int conf_no, ret = 0;
+
+	trace_tasdevice_load_begin(TASDEVICE_LOAD_REGBIN, -1);
+	if (unlikely(!pFW) || unlikely(!pFW->data)) {
+		dev_err(tas_dev->dev, "%s: Failed to read %s\n", __func__,
+			tas_dev->regbin_binaryname);
+		ret = -ENOENT;
+		goto out;
+	}
+
+	next = kzalloc(sizeof(*next), GFP_KERNEL);
+	if (!next) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	mutex_init(&next->parse_lock);
+	ret = tasdevice_regbin_parse(tas_dev, pFW, next);
+	if (ret) {
+		ret = -EINVAL;
+		goto out;
+	}
+	pFW = NULL;
+
+	/* Parsed here so that the swap has nothing left to do but swap */
+	tasdevice_config_preload(tas_dev, next);
+	conf_no = READ_ONCE(tas_dev->mtRegbin.profile_cfg_id);
+	if (conf_no >= 0 && !tasdevice_regbin_cfg(tas_dev, next, conf_no)) {
+		dev_err(tas_dev->dev, "%s: profile %d does not load\n",
+			__func__, conf_no);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&tas_dev->codec_lock);
+	if (tas_dev->regbin_reload_off) {
+		ret = -ESHUTDOWN;
+	} else if (next->ncfgs != tas_dev->mtRegbin.ncfgs) {
+		dev_err(tas_dev->dev, "%s: %d profiles instead of %d, needs "
+			"a driver reload\n", __func__, next->ncfgs,
+			tas_dev->mtRegbin.ncfgs);
+		ret = -EINVAL;
+	} else {
+		/* A reload still waiting for its stream is superseded */
+		swap(tas_dev->regbin_next, next);
+		if (!tas_dev->pstream && !tas_dev->cstream)
+			tasdevice_regbin_swap(tas_dev);
+	}
+	mutex_unlock(&tas_dev->codec_lock);
+
+out:
+	tasdevice_regbin_next_free(next);
+	trace_tasdevice_load_end(TASDEVICE_LOAD_REGBIN, -1, ret);
+	if (pFW)
+		release_firmware(pFW);
+	/* Last touch of tas_dev, tasdevice_regbin_reload_stop() waits */
+	complete_all(&tas_dev->regbin_reload_done);
+}
+
+/* One reload at a time, none once tasdevice_regbin_reload_stop() ran */
+int tasdevice_regbin_reload(void *pContext)
+{
+	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+	int ret = 0;
+
+	mutex_lock(&tas_dev->codec_lock);
+	if (tas_dev->fw_state != TASDEVICE_DSP_FW_ALL_OK ||
+		tas_dev->regbin_reload_off) {
+		dev_err(tas_dev->dev, "%s: no regbin in use\n", __func__);
+		ret = -ENODEV;
+		goto out;
+	}
+	if (!completion_done(&tas_dev->regbin_reload_done)) {
+		ret = -EBUSY;
+		goto out;
+	}
+	reinit_completion(&tas_dev->regbin_reload_done);
+	ret = request_firmware_nowait(THIS_MODULE, FW_ACTION_UEVENT,
+		tas_dev->regbin_binaryname, tas_dev->dev, GFP_KERNEL,
+		tas_dev, tasdevice_regbin_reload_ready);
+	if (ret) {
+		dev_err(tas_dev->dev, "%s: request_firmware_nowait error "
+			"%d\n", __func__, ret);
+		complete_all(&tas_dev->regbin_reload_done);
+	}
+out:
+	mutex_unlock(&tas_dev->codec_lock);
+	return ret;
+}
+
+/*
+ * Refuse further reloads and wait for one in flight. Called without
+ * codec_lock, which the reload callback takes.
+ */
+void tasdevice_regbin_reload_stop(void *pContext)
+{
+	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) pContext;
+
+	mutex_lock(&tas_dev->codec_lock);
+	tas_dev->regbin_reload_off = true;
+	mutex_unlock(&tas_dev->codec_lock);
+	wait_for_completion(&tas_dev->regbin_reload_done);
+}
+
 void tasdevice_config_info_remove(void *ctxt)
 {
 	struct tasdevice_priv *tas_dev = (struct tasdevice_priv *) ctxt;
 	struct tasdevice_regbin *regbin = &(tas_dev->mtRegbin);
-	struct tasdevice_config_info **cfg_info = regbin->cfg_info;
-	int i, j;
+	int i;
 
+	tasdevice_regbin_next_free(tas_dev->regbin_next);
+	tas_dev->regbin_next = NULL;
 	mutex_lock(&tas_dev->dev_lock);
-	if (!cfg_info)
-		return;
-	for (i = 0; i < regbin->ncfgs; i++) {
-		if (!cfg_info[i])
-			continue;
-		if (cfg_info[i]->blk_data) {
-			for (j = 0; j < (int)cfg_info[i]->real_nblocks; j++) {
-				if (!cfg_info[i]->blk_data[j])
-					continue;
-				kfree(cfg_info[i]->blk_data[j]->regdata);
-				kfree(cfg_info[i]->blk_data[j]);
-			}
-			kfree(cfg_info[i]->blk_data);
-		}
-		kfree(cfg_info[i]);
-	}
-	kfree(cfg_info);
+	for (i = 0; i < tas_dev->ndev; i++)
+		tas_dev->tasdevice[i].mnAppliedRegConf = -1;
+	mutex_lock(&regbin->parse_lock);
+	tasdevice_regbin_free(regbin);
+	mutex_unlock(&regbin->parse_lock);
 	mutex_unlock(&tas_dev->dev_lock);
 }
@@ -54,6 +54,24 @@ struct tasdevice_regbin_hdr {
 	unsigned int config_size[TASDEVICE_CONFIG_SUM];
 };
 
+/*
+ * One step of a compiled block. Write runs stay within one book/page and
+ * one TASDEVICE_SEQ_CHUNK; bursts point into regdata.
+ */
+struct tasdevice_blk_op {
+	unsigned char cmd;
+	/* FIELD_W only */
+	unsigned char mask;
+	unsigned char val;
+	/* Registers of a write run, bytes of a burst, ms of a delay */
+	unsigned short len;
+	unsigned int reg;
+	union {
+		struct reg_sequence *seq;
+		unsigned char *data;
+	};
+};
+
 struct tasdevice_block_data {
 	unsigned char dev_idx;
 	unsigned char block_type;
@@ -61,6 +79,18 @@ struct tasdevice_block_data {
 	unsigned int block_size;
 	unsigned int nSublocks;
 	unsigned char *regdata;
+	/* Same data for every device: the first copy goes by broadcast */
+	bool bBcast;
+	bool bBcastDup;
+	/* regdata decoded and checked once at load, NULL if malformed */
+	struct tasdevice_blk_op *ops;
+	unsigned int nops;
+	struct reg_sequence *seqs;
+	/* Register writes in the block; plain writes only, no delays,
+	 * selectors, resets or masks
+	 */
+	unsigned int nwrites;
+	bool bStatic;
 };
 
 struct tasdevice_config_info {
@@ -69,11 +99,25 @@ struct tasdevice_config_info {
 	unsigned int real_nblocks;
 	unsigned char active_dev;
 	struct tasdevice_block_data **blk_data;
+	/* PRE_POWER_UP writes per device in order, NULL unless static */
+	struct reg_sequence *image[TASDEVICE_DEVICE_SUM];
+	unsigned int nimage[TASDEVICE_DEVICE_SUM];
+	/* Where the config sits in tasdevice_regbin.fw */
+	unsigned int offset;
+	unsigned int size;
+	/* Blocks parsed on first use, see tasdevice_config_get() */
+	void *arena;
+	bool bParsed;
 };
 
 struct tasdevice_regbin {
 	struct tasdevice_regbin_hdr fw_hdr;
 	struct tasdevice_config_info **cfg_info;
+	/* Holds cfg_info; the blocks of a config live in its own arena */
+	void *arena;
+	/* Kept for the configs that are not parsed yet, blocks point in */
+	const struct firmware *fw;
+	struct mutex parse_lock;
 	int profile_cfg_id;
 	int rotation_id;
 	int direct_rotation_cfg_id;
@@ -84,6 +128,11 @@ struct tasdevice_regbin {
 void tasdevice_regbin_ready(const struct firmware *pFW,
 	void *pContext);
 void tasdevice_config_info_remove(void *pContext);
+int tasdevice_regbin_reload(void *pContext);
+void tasdevice_regbin_reload_stop(void *pContext);
+void tasdevice_regbin_swap(void *pContext);
+struct tasdevice_config_info *tasdevice_config_get(void *pContext,
+	int conf_no);
 void tasdevice_powerup_regcfg_dev(void *pContext,
 	unsigned char dev);
 void tasdevice_select_cfg_blk(void *pContext, int conf_no,
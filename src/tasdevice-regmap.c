@@ -0,0 +1,364 @@
+/*
+ * TAS2563/TAS2871 Linux Driver
+ *
+ * Copyright (C) 2022 - 2024 Texas Instruments Incorporated
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <asm/unaligned.h>
+#include <linux/crc8.h>
+#include <linux/firmware.h>
+#include <linux/module.h>
+#include <linux/regmap.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+
+#include "tasdevice.h"
+#include "tasdevice-regmap.h"
+#include "tasdevice-trace.h"
+#include "tas2563-reg.h"
+#include "tas2781-reg.h"
+
+/*
+ * Interrupt live/latch, ADC readback and the I2C checksum change behind
+ * the driver's back, as does everything in the DSP books, see
+ * tasdevice_is_dsp_book(). The rest of book 0 (config, gain) only
+ * changes when we write it and can be served from the cache.
+ */
+static const struct regmap_range tas2781_volatile_ranges[] = {
+	/* The chip drops out of active mode by itself on faults */
+	regmap_reg_range(TASDEVICE_REG_SWRESET, TASDEVICE_REG(0x0, 0x0, 0x02)),
+	regmap_reg_range(TASDEVICE_REG(0x0, 0x0, 0x44),
+		TASDEVICE_REG(0x0, 0x0, 0x51)),
+	regmap_reg_range(TASDEVICE_REG(0x0, 0x0, 0x5a),
+		TASDEVICE_REG(0x0, 0x0, 0x6f)),
+	regmap_reg_range(TASDEVICE_I2CChecksum, TASDEVICE_I2CChecksum),
+};
+
+static const struct regmap_range tas2563_volatile_ranges[] = {
+	regmap_reg_range(TASDEVICE_REG_SWRESET, TASDEVICE_REG(0x0, 0x0, 0x02)),
+	regmap_reg_range(TASDEVICE_REG(0x0, 0x0, 0x1f),
+		TASDEVICE_REG(0x0, 0x0, 0x2d)),
+	regmap_reg_range(TASDEVICE_I2CChecksum, TASDEVICE_I2CChecksum),
+};
+
+/* Clear-on-read interrupt latches, never read them speculatively */
+static const struct regmap_range tas2781_precious_ranges[] = {
+	regmap_reg_range(TAS2781_REG_INT_LTCH0, TAS2781_REG_INT_LTCH1_0),
+	regmap_reg_range(TAS2781_REG_INT_LTCH2, TAS2781_REG_INT_LTCH4),
+};
+
+static const struct regmap_range tas2563_precious_ranges[] = {
+	regmap_reg_range(TAS2563_REG_INT_LTCH0, TAS2563_REG_INT_LTCH4),
+};
+
+static const struct regmap_access_table tas2781_precious_table = {
+	.yes_ranges = tas2781_precious_ranges,
+	.n_yes_ranges = ARRAY_SIZE(tas2781_precious_ranges),
+};
+
+static const struct regmap_access_table tas2563_precious_table = {
+	.yes_ranges = tas2563_precious_ranges,
+	.n_yes_ranges = ARRAY_SIZE(tas2563_precious_ranges),
+};
+
+/* Software reset is write-only */
+static const struct regmap_range tasdevice_unreadable_ranges[] = {
+	regmap_reg_range(TASDEVICE_REG_SWRESET, TASDEVICE_REG_SWRESET),
+};
+
+static const struct regmap_access_table tasdevice_readable_table = {
+	.no_ranges = tasdevice_unreadable_ranges,
+	.n_no_ranges = ARRAY_SIZE(tasdevice_unreadable_ranges),
+};
+
+/* R0 of every page and B*P0R127 are the selectors the bus owns */
+static bool tasdevice_is_selector(unsigned int reg)
+{
+	return TASDEVICE_PAGE_REG(reg) == TASDEVICE_PAGE_SELECT ||
+		(TASDEVICE_PAGE_ID(reg) == TASDEVICE_BOOKCTL_PAGE &&
+		TASDEVICE_PAGE_REG(reg) == TASDEVICE_BOOKCTL_REG);
+}
+
+/*
+ * Books above 0 are DSP coefficient and YRAM memory, which the running
+ * firmware rewrites by itself. A cached copy would let a coefficient
+ * reload be skipped as "unchanged" while the chip runs other values.
+ */
+static bool tasdevice_is_dsp_book(unsigned int reg)
+{
+	return TASDEVICE_BOOK_ID(reg) != 0;
+}
+
+static bool tas2781_volatile(struct device *dev, unsigned int reg)
+{
+	return tasdevice_is_selector(reg) || tasdevice_is_dsp_book(reg) ||
+		regmap_reg_in_ranges(reg, tas2781_volatile_ranges,
+			ARRAY_SIZE(tas2781_volatile_ranges));
+}
+
+static bool tas2563_volatile(struct device *dev, unsigned int reg)
+{
+	return tasdevice_is_selector(reg) || tasdevice_is_dsp_book(reg) ||
+		regmap_reg_in_ranges(reg, tas2563_volatile_ranges,
+			ARRAY_SIZE(tas2563_volatile_ranges));
+}
+
+/*
+ * The regmap register is the full TASDEVICE_REG() value, i.e. book,
+ * page and offset. The bus below writes the book (B*P0R127) and page
+ * (R0) selectors only when they differ from what the addressed chip
+ * last saw, so every access pattern (volume, regdump, DSP download)
+ * pays for a selector write only on a real book or page change.
+ * Volatile and precious tables are filled in per chip at probe.
+ */
+static const struct regmap_config tasdevice_regmap = {
+	.reg_bits = 32,
+	.val_bits = 8,
+#if KERNEL_VERSION(6, 4, 0) <= LINUX_VERSION_CODE
+	.cache_type = REGCACHE_MAPLE,
+#else
+	.cache_type = REGCACHE_RBTREE,
+#endif
+	.rd_table = &tasdevice_readable_table,
+	.max_register = TASDEVICE_REG(255, 255, 127),
+};
+
+/*
+ * A selector write or reset on one instance also moves the other side.
+ * A broadcast puts every chip on the broadcast book/page. The broadcast
+ * instance is on a known book/page only while all chips agree on it.
+ * Syncing from the real state instead of forgetting it means going
+ * back and forth between chips (or to broadcast) costs no selector
+ * write as long as they stay in the same place.
+ */
+void tasdevice_bus_sync(struct tasdevice_t *tasdev)
+{
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	struct tasdevice_t *glb = &tas_priv->tasdevice[tas_priv->ndev];
+	int i, book, page;
+
+	if (!glb->regmap)
+		return;
+	if (tasdev == glb) {
+		for (i = 0; i < tas_priv->ndev; i++) {
+			tas_priv->tasdevice[i].cur_book = glb->cur_book;
+			tas_priv->tasdevice[i].cur_page = glb->cur_page;
+		}
+		return;
+	}
+
+	book = tas_priv->tasdevice[0].cur_book;
+	page = tas_priv->tasdevice[0].cur_page;
+	for (i = 1; i < tas_priv->ndev; i++) {
+		if (tas_priv->tasdevice[i].cur_book != book ||
+			tas_priv->tasdevice[i].cur_page != page) {
+			book = -1;
+			page = -1;
+			break;
+		}
+	}
+	if (book < 0 || page < 0) {
+		book = -1;
+		page = -1;
+	}
+	glb->cur_book = book;
+	glb->cur_page = page;
+}
+
+int tasdevice_bus_select(struct tasdevice_t *tasdev,
+	unsigned char book, unsigned char page)
+{
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	unsigned short chn = tasdev - tas_priv->tasdevice;
+	unsigned char zero = 0;
+	int ret = 0;
+
+	if (tasdev->cur_book == book && tasdev->cur_page == page)
+		return 0;
+
+	if (tasdev->cur_book != book) {
+		if (tasdev->cur_page != TASDEVICE_BOOKCTL_PAGE) {
+			ret = tas_priv->bus_send(tasdev,
+				TASDEVICE_PAGE_SELECT, &zero, 1);
+			trace_tasdevice_page_switch(chn, tasdev->mnDevAddr,
+				zero, ret);
+			if (ret < 0)
+				goto out;
+			tasdev->cur_page = TASDEVICE_BOOKCTL_PAGE;
+			tasdev->bus_stats.page_switches++;
+		}
+		ret = tas_priv->bus_send(tasdev, TASDEVICE_BOOKCTL_REG,
+			&book, 1);
+		trace_tasdevice_book_switch(chn, tasdev->mnDevAddr, book, ret);
+		if (ret < 0)
+			goto out;
+		tasdev->cur_book = book;
+		tasdev->bus_stats.book_switches++;
+	}
+	if (tasdev->cur_page != page) {
+		ret = tas_priv->bus_send(tasdev, TASDEVICE_PAGE_SELECT,
+			&page, 1);
+		trace_tasdevice_page_switch(chn, tasdev->mnDevAddr, page, ret);
+		if (ret < 0)
+			goto out;
+		tasdev->cur_page = page;
+		tasdev->bus_stats.page_switches++;
+	}
+out:
+	if (ret < 0) {
+		tasdev->cur_book = -1;
+		tasdev->cur_page = -1;
+	}
+	tasdevice_bus_sync(tasdev);
+	return ret;
+}
+
+/* Keep the selector state right when the payload itself hits them */
+void tasdevice_bus_track(struct tasdevice_t *tasdev,
+	unsigned char page, unsigned char reg,
+	const unsigned char *val, size_t len)
+{
+	if (page == TASDEVICE_BOOKCTL_PAGE &&
+		reg <= TASDEVICE_BOOKCTL_REG &&
+		reg + len > TASDEVICE_BOOKCTL_REG) {
+		tasdev->cur_book = val[TASDEVICE_BOOKCTL_REG - reg];
+		tasdev->cur_page = -1;
+		tasdevice_bus_sync(tasdev);
+	}
+	if (reg == TASDEVICE_PAGE_SELECT) {
+		tasdev->cur_page = val[0];
+		tasdevice_bus_sync(tasdev);
+	}
+	if (tasdev->cur_book == 0 && page == 0 &&
+		reg <= TASDEVICE_PAGE_REG(TASDEVICE_REG_SWRESET) &&
+		reg + len > TASDEVICE_PAGE_REG(TASDEVICE_REG_SWRESET) &&
+		(val[TASDEVICE_PAGE_REG(TASDEVICE_REG_SWRESET) - reg] &
+		TASDEVICE_REG_SWRESET_RESET)) {
+		/* Selectors are back to their reset values */
+		tasdev->cur_book = 0;
+		tasdev->cur_page = 0;
+		tasdevice_bus_sync(tasdev);
+	}
+}
+
+static int tasdevice_bus_write(void *context, const void *data,
+	size_t count)
+{
+	struct tasdevice_t *tasdev = context;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	const unsigned char *val = (const unsigned char *)data + 4;
+	unsigned int reg = get_unaligned_be32(data);
+	unsigned char page, offset;
+	size_t len;
+	int ret = 0;
+
+	count -= 4;
+	while (count) {
+		page = TASDEVICE_PAGE_ID(reg);
+		offset = TASDEVICE_PAGE_REG(reg);
+		/* Never let the chip auto-increment across a page */
+		len = min_t(size_t, count, 128 - offset);
+		len = min_t(size_t, len, tas_priv->buses[tasdev->bus].max_wr);
+
+		ret = tasdevice_bus_select(tasdev, TASDEVICE_BOOK_ID(reg),
+			page);
+		if (ret < 0)
+			break;
+		ret = tas_priv->bus_send(tasdev, offset, val, len);
+		if (ret < 0)
+			break;
+		tasdev->bus_stats.xfers++;
+		tasdev->bus_stats.bytes_wr += len;
+		tasdevice_bus_track(tasdev, page, offset, val, len);
+
+		reg += len;
+		val += len;
+		count -= len;
+	}
+	return ret;
+}
+
+static int tasdevice_bus_read(void *context, const void *reg_buf,
+	size_t reg_size, void *val_buf, size_t val_size)
+{
+	struct tasdevice_t *tasdev = context;
+	struct tasdevice_priv *tas_priv = tasdev->priv;
+	unsigned int reg = get_unaligned_be32(reg_buf);
+	unsigned char *val = val_buf;
+	size_t len;
+	int ret = 0;
+
+	while (val_size) {
+		len = min_t(size_t, val_size, 128 - TASDEVICE_PAGE_REG(reg));
+		len = min_t(size_t, len, tas_priv->buses[tasdev->bus].max_rd);
+
+		ret = tasdevice_bus_select(tasdev, TASDEVICE_BOOK_ID(reg),
+			TASDEVICE_PAGE_ID(reg));
+		if (ret < 0)
+			break;
+		ret = tas_priv->bus_recv(tasdev, reg, val, len);
+		if (ret < 0)
+			break;
+		tasdev->bus_stats.xfers++;
+		tasdev->bus_stats.bytes_rd += len;
+
+		reg += len;
+		val += len;
+		val_size -= len;
+	}
+	return ret;
+}
+
+static const struct regmap_bus tasdevice_regmap_bus = {
+	.write = tasdevice_bus_write,
+	.read = tasdevice_bus_read,
+	.reg_format_endian_default = REGMAP_ENDIAN_BIG,
+	.val_format_endian_default = REGMAP_ENDIAN_NATIVE,
+};
+
+/*
+ * Regmap of one chip (or of the broadcast instance) on top of the
+ * transport's bus_send/bus_recv, which must be set up before.
+ */
+int tasdevice_regmap_init(struct tasdevice_priv *tas_priv,
+	struct tasdevice_t *tasdev)
+{
+	struct regmap_config cfg = tasdevice_regmap;
+	int ret = 0;
+
+	if (tas_priv->chip_id == TAS2781) {
+		cfg.volatile_reg = tas2781_volatile;
+		cfg.precious_table = &tas2781_precious_table;
+	} else {
+		cfg.volatile_reg = tas2563_volatile;
+		cfg.precious_table = &tas2563_precious_table;
+	}
+	if (tasdev->bus)
+		cfg.name = devm_kasprintf(tas_priv->dev, GFP_KERNEL, "%u-%02x",
+			tasdev->bus, tasdev->mnDevAddr);
+	else
+		cfg.name = devm_kasprintf(tas_priv->dev, GFP_KERNEL, "%02x",
+			tasdev->mnDevAddr);
+
+	tasdev->priv = tas_priv;
+	tasdev->cur_book = -1;
+	tasdev->cur_page = -1;
+	tasdev->regmap = devm_regmap_init(tas_priv->dev,
+		&tasdevice_regmap_bus, tasdev, &cfg);
+	if (IS_ERR(tasdev->regmap)) {
+		ret = PTR_ERR(tasdev->regmap);
+		tasdev->regmap = NULL;
+		dev_err(tas_priv->dev, "%s: Failed to allocate register map "
+			"for 0x%02x: %d\n", __func__, tasdev->mnDevAddr, ret);
+	}
+	return ret;
+}
@@ -15,6 +15,10 @@
 
 #include <linux/crc8.h>
 #include <linux/firmware.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/module.h>
 #include <linux/regmap.h>
 #ifdef CONFIG_TASDEV_CODEC_SPI
 	#include <linux/spi/spi.h>
@@ -25,188 +29,770 @@
 #include "tasdevice.h"
 #include "tasdevice-rw.h"
 
-static int tasdevice_regmap_write(
-	struct tasdevice_priv *tas_priv,
-	unsigned int reg, unsigned int value)
+#define CREATE_TRACE_POINTS
+#include "tasdevice-trace.h"
+
+/*
+ * Retry engine shared by all regmap accessors. How often and how fast a
+ * failed transfer is retried depends on what went wrong: arbitration
+ * loss clears up within microseconds, a NACK usually means the chip is
+ * busy for a little longer, a bus timeout needs real time, and errors
+ * that do not come from the bus are never retried. The delay doubles on
+ * every attempt up to max_backoff_us.
+ */
+struct tasdevice_retry_policy {
+	int err;
+	unsigned char retries;
+	unsigned short base_us;
+};
+
+static const struct tasdevice_retry_policy tasdevice_retry_policies[] = {
+	{ -EAGAIN,	5,	20 },
+	{ -ENXIO,	3,	100 },
+	{ -EREMOTEIO,	3,	100 },
+	{ -EIO,		3,	100 },
+	{ -ETIMEDOUT,	2,	1000 },
+	{ -EINVAL,	0,	0 },
+	{ -ENOMEM,	0,	0 },
+	{ -EOPNOTSUPP,	0,	0 },
+	{ -EBUSY,	0,	0 },
+};
+
+/* Errors not listed above fail fast */
+static const struct tasdevice_retry_policy tasdevice_retry_default = {
+	0, 0, 0
+};
+
+static unsigned int max_backoff_us = 5000;
+module_param(max_backoff_us, uint, 0644);
+MODULE_PARM_DESC(max_backoff_us, "Upper bound of a single retry delay");
+
+static unsigned int breaker_threshold = 8;
+module_param(breaker_threshold, uint, 0644);
+MODULE_PARM_DESC(breaker_threshold,
+	"Consecutive failed accesses before a channel is shut off, 0: never");
+
+static unsigned int preempt_chunk = 256;
+module_param(preempt_chunk, uint, 0644);
+MODULE_PARM_DESC(preempt_chunk,
+	"Bytes of a download bulk write between two preemption points, 0: off");
+
+static unsigned int preempt_wait_ms = 10;
+module_param(preempt_wait_ms, uint, 0644);
+MODULE_PARM_DESC(preempt_wait_ms,
+	"Longest a download steps aside for queued control writes");
+
+static unsigned int breaker_cooldown_ms = 1000;
+module_param(breaker_cooldown_ms, uint, 0644);
+MODULE_PARM_DESC(breaker_cooldown_ms,
+	"How long a shut-off channel fails fast before it is tried again");
+
+static unsigned int delay_slack_us = 50;
+module_param(delay_slack_us, uint, 0644);
+MODULE_PARM_DESC(delay_slack_us,
+	"Slack allowed past the end of a firmware or regbin delay");
+
+static const struct tasdevice_retry_policy *tasdevice_retry_policy(int err)
 {
-	int nResult = 0;
-	int retry_count = TASDEVICE_RETRY_COUNT;
+	int i;
 
-	while (retry_count--) {
-		nResult = regmap_write(tas_priv->regmap, reg,
-			value);
-		if (nResult >= 0)
-			break;
-		usleep_range(5000, 5050);
-	}
-	if (retry_count == -1)
-		return TASDEVICE_ERROR_FAILED;
-	else
+	for (i = 0; i < ARRAY_SIZE(tasdevice_retry_policies); i++)
+		if (tasdevice_retry_policies[i].err == err)
+			return &tasdevice_retry_policies[i];
+	return &tasdevice_retry_default;
+}
+
+/*
+ * Circuit breaker: a channel that failed breaker_threshold accesses in
+ * a row is not touched for breaker_cooldown_ms, after which a single
+ * access decides whether it is back.
+ */
+static int tasdevice_breaker_check(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_t *tasdev = &tas_priv->tasdevice[chn];
+
+	if (!breaker_threshold || tasdev->consec_fail < breaker_threshold)
 		return 0;
+	if (time_before(jiffies, tasdev->breaker_until)) {
+		tasdev->bus_stats.fast_fails++;
+		return -EHOSTDOWN;
+	}
+	/* Half open: let this access through as a probe */
+	tasdev->consec_fail = breaker_threshold - 1;
+	return 0;
 }
 
-static int tasdevice_regmap_bulk_write(
-	struct tasdevice_priv *tas_priv, unsigned int reg,
-	unsigned char *pData, unsigned int nLength)
+/*
+ * Called after every attempt with its result; returns true after
+ * sleeping when the access should be attempted again.
+ */
+static bool tasdevice_retry(struct tasdevice_priv *tas_priv,
+	unsigned short chn, int ret, int attempt)
 {
-	int nResult = 0;
-	int retry_count = TASDEVICE_RETRY_COUNT;
+	struct tasdevice_t *tasdev = &tas_priv->tasdevice[chn];
+	const struct tasdevice_retry_policy *policy;
+	unsigned int delay_us;
 
-	while (retry_count--) {
-		nResult = regmap_bulk_write(tas_priv->regmap, reg,
-				pData, nLength);
-		if (nResult >= 0)
-			break;
-		usleep_range(5000, 5050);
+	if (ret >= 0) {
+		tasdev->consec_fail = 0;
+		return false;
 	}
-	if (retry_count == -1)
-		return TASDEVICE_ERROR_FAILED;
+
+	policy = tasdevice_retry_policy(ret);
+	if (attempt < policy->retries) {
+		delay_us = min_t(unsigned int,
+			policy->base_us << attempt, max_backoff_us);
+		usleep_range(delay_us, delay_us + delay_us / 4 + 1);
+		tasdev->bus_stats.retries++;
+		return true;
+	}
+
+	tasdev->bus_stats.failures++;
+	/* >=: breaker_threshold may have been lowered meanwhile */
+	if (++tasdev->consec_fail >= breaker_threshold && breaker_threshold) {
+		tasdev->breaker_until = jiffies +
+			msecs_to_jiffies(breaker_cooldown_ms);
+		tasdev->bus_stats.breaker_trips++;
+		dev_err(tas_priv->dev, "%s: chn %d shut off for %u ms, E=%d\n",
+			__func__, chn, breaker_cooldown_ms, ret);
+	}
+	return false;
+}
+
+/*
+ * Account for one access through the retry engine once it has settled,
+ * attempt being the number of transfers it took. The latency is per
+ * accessor call, so a read served from the regmap cache still shows up
+ * here; transfers and bytes are counted by the regmap bus, see
+ * tasdevice_bus_write().
+ */
+static void tasdevice_io_done(struct tasdevice_priv *tas_priv,
+	unsigned short chn, int op, unsigned int reg, unsigned int len,
+	int ret, int attempt, u64 t0)
+{
+	struct tasdevice_bus_stats *stats = &tas_priv->tasdevice[chn].bus_stats;
+	u64 ns = ktime_get_ns() - t0;
+	unsigned long us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int bucket;
+
+	trace_tasdevice_io(chn, tas_priv->tasdevice[chn].mnDevAddr, op, reg,
+		len, ret, attempt ? attempt - 1 : 0, ns);
+
+	bucket = us ? min_t(unsigned int, ilog2(us) + 1,
+		TASDEVICE_LAT_BUCKETS - 1) : 0;
+	if (len > 1)
+		stats->lat_bulk[bucket]++;
 	else
-		return 0;
+		stats->lat_single[bucket]++;
 }
 
-static int tasdevice_regmap_read(
-	struct tasdevice_priv *tas_priv,
-	unsigned int reg, unsigned int *value)
+static int tasdevice_regmap_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned int value)
 {
-	int nResult = 0;
-	int retry_count = TASDEVICE_RETRY_COUNT;
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
 
-	while (retry_count--) {
-		nResult = regmap_read(tas_priv->regmap, reg,
-			value);
-		if (nResult >= 0)
-			break;
-		usleep_range(5000, 5050);
-	}
-	if (retry_count == -1)
-		return TASDEVICE_ERROR_FAILED;
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_write(map, reg, value);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_WRITE, reg,
+		1, ret, attempt, t0);
+	return ret;
+}
+
+static int tasdevice_regmap_bulk_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char *pData,
+	unsigned int nLength)
+{
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
+
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_bulk_write(map, reg, pData, nLength);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_BULK_WRITE, reg,
+		nLength, ret, attempt, t0);
+	return ret;
+}
+
+static int tasdevice_regmap_read(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned int *value)
+{
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
+
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_read(map, reg, value);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_READ, reg,
+		1, ret, attempt, t0);
+	return ret;
+}
+
+static int tasdevice_regmap_bulk_read(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char *pData,
+	unsigned int nLength)
+{
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
+
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_bulk_read(map, reg, pData, nLength);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_BULK_READ, reg,
+		nLength, ret, attempt, t0);
+	return ret;
+}
+
+static int tasdevice_regmap_update_bits(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned int mask,
+	unsigned int value)
+{
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
+
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_update_bits(map, reg, mask, value);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_UPDATE_BITS, reg,
+		1, ret, attempt, t0);
+	return ret;
+}
+
+static int tasdevice_regmap_multi_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, const struct reg_sequence *regs, int num_regs)
+{
+	struct regmap *map = tas_priv->tasdevice[chn].regmap;
+	u64 t0 = ktime_get_ns();
+	int ret, attempt = 0;
+
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret < 0)
+		goto out;
+	do {
+		ret = regmap_multi_reg_write(map, regs, num_regs);
+	} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+out:
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_MULTI_WRITE,
+		num_regs ? regs[0].reg : 0, num_regs, ret, attempt, t0);
+	return ret;
+}
+
+/*
+ * Control writes (volume, gain, ...) announce themselves here before
+ * taking the bus lock, so a download in a preemptible session lets them go
+ * at its next access instead of after the whole firmware. Mute and
+ * shutdown are not among them: they run the power-up download themselves
+ * under codec_lock, so there is nothing for them to cut into.
+ */
+void tasdevice_prio_begin(struct tasdevice_priv *tas_priv)
+{
+	atomic_inc(&tas_priv->prio_waiters);
+}
+
+void tasdevice_prio_end(struct tasdevice_priv *tas_priv)
+{
+	if (atomic_dec_and_test(&tas_priv->prio_waiters))
+		wake_up(&tas_priv->prio_wq);
+}
+
+static void tasdevice_prio_wait(struct tasdevice_priv *tas_priv)
+{
+	wait_event_timeout(tas_priv->prio_wq,
+		!atomic_read(&tas_priv->prio_waiters),
+		msecs_to_jiffies(preempt_wait_ms));
+}
+
+/* Bus chn sits on; unknown channels are refused later, under bus 0 */
+static struct tasdevice_bus *tasdevice_chn_bus(
+	struct tasdevice_priv *tas_priv, unsigned short chn)
+{
+	if (chn > tas_priv->ndev)
+		chn = 0;
+	return &tas_priv->buses[tas_priv->tasdevice[chn].bus];
+}
+
+/* The lock chn's accesses, and so its bus_stats, are made under */
+struct mutex *tasdevice_chn_lock(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	return tasdevice_chn_bus(tas_priv, chn)->lock;
+}
+
+/*
+ * Step aside for queued control writes. Only a download in a preemptible
+ * session does: any other caller may be in the middle of a sequence that
+ * must reach the chip as a whole, e.g. a config write or a DSP block in
+ * a plain session. Nothing is given up while the chip's I2C checksum is
+ * summing the download (bNoShadow), as anything else written to it would
+ * spoil the sum.
+ */
+static void tasdevice_yield(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+
+	if (!atomic_read(&tas_priv->prio_waiters) || chn > tas_priv->ndev)
+		return;
+	if (READ_ONCE(bus->session_owner) != current ||
+		!bus->session_preempt)
+		return;
+	if (tas_priv->tasdevice[chn].bNoShadow)
+		return;
+
+	WRITE_ONCE(bus->session_owner, NULL);
+	mutex_unlock(bus->lock);
+	tasdevice_prio_wait(tas_priv);
+	mutex_lock(bus->lock);
+	WRITE_ONCE(bus->session_owner, current);
+	tas_priv->act_chn = chn;
+	tas_priv->tasdevice[chn].bus_stats.yields++;
+}
+
+/*
+ * Bus sessions keep the bus lock for a whole sequence of accesses, e.g.
+ * one DSP block on one channel, so nothing else can slip in between and
+ * the lock is taken once instead of per register. The accessors notice
+ * that the calling task owns the session and skip locking, so code
+ * inside a session keeps using tas_priv->read/write and friends
+ * unchanged. Every access in a preemptible session is also a preemption
+ * point. Sessions are per bus, a task may hold one on each.
+ */
+static void tasdevice_lock(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+
+	if (READ_ONCE(bus->session_owner) != current)
+		mutex_lock(bus->lock);
 	else
+		tasdevice_yield(tas_priv, chn);
+}
+
+static void tasdevice_unlock(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+
+	if (READ_ONCE(bus->session_owner) != current)
+		mutex_unlock(bus->lock);
+}
+
+int tasdevice_session_begin(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+
+	if (READ_ONCE(bus->session_owner) == current) {
+		bus->session_depth++;
 		return 0;
+	}
+
+	if (chn > tas_priv->ndev || !tas_priv->tasdevice[chn].regmap) {
+		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
+			__func__, chn);
+		return -EINVAL;
+	}
+
+	mutex_lock(bus->lock);
+	WRITE_ONCE(bus->session_owner, current);
+	bus->session_depth = 0;
+	bus->session_preempt = false;
+	tas_priv->act_chn = chn;
+
+	return 0;
 }
 
-static int tasdevice_regmap_bulk_read(
-	struct tasdevice_priv *tas_priv, unsigned int reg,
-	unsigned char *pData, unsigned int nLength)
+/*
+ * Session for a firmware download: control writes queued meanwhile get
+ * the bus between two accesses of it. Nested inside another session the
+ * outer one decides.
+ */
+int tasdevice_session_begin_preempt(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
 {
-	int nResult = 0;
-	int retry_count = TASDEVICE_RETRY_COUNT;
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+	int ret;
 
-	while (retry_count--) {
-		nResult = regmap_bulk_read(tas_priv->regmap, reg,
-			pData, nLength);
-		if (nResult >= 0)
-			break;
-		usleep_range(5000, 5050);
+	if (READ_ONCE(bus->session_owner) == current)
+		return tasdevice_session_begin(tas_priv, chn);
+
+	if (atomic_read(&tas_priv->prio_waiters))
+		tasdevice_prio_wait(tas_priv);
+	ret = tasdevice_session_begin(tas_priv, chn);
+	if (ret == 0)
+		bus->session_preempt = true;
+	return ret;
+}
+
+void tasdevice_session_end(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	struct tasdevice_bus *bus = tasdevice_chn_bus(tas_priv, chn);
+
+	if (WARN_ON(READ_ONCE(bus->session_owner) != current))
+		return;
+
+	if (bus->session_depth) {
+		bus->session_depth--;
+		return;
 	}
-	if (retry_count == -1)
-		return TASDEVICE_ERROR_FAILED;
-	else
-		return 0;
+	bus->session_preempt = false;
+	WRITE_ONCE(bus->session_owner, NULL);
+	mutex_unlock(bus->lock);
+}
+
+/*
+ * Channels the calling task works on. A worker of tasdevice_bus_parallel()
+ * only takes the amps on its own bus; everybody else takes all of them.
+ */
+bool tasdevice_chn_mine(struct tasdevice_priv *tas_priv, unsigned short chn)
+{
+	int i;
+
+	if (tas_priv->nbus < 2 || chn > tas_priv->ndev)
+		return true;
+	for (i = 0; i < tas_priv->nbus; i++)
+		if (READ_ONCE(tas_priv->buses[i].loader) == current)
+			return tas_priv->tasdevice[chn].bus == i;
+	return true;
+}
+
+static void tasdevice_bus_load_work(struct work_struct *work)
+{
+	struct tasdevice_bus *bus =
+		container_of(work, struct tasdevice_bus, load_work);
+
+	WRITE_ONCE(bus->loader, current);
+	bus->load_ret = bus->load_fn(bus->priv, bus->load_arg);
+	WRITE_ONCE(bus->loader, NULL);
+}
+
+/*
+ * Run fn once per bus at the same time, each run restricted to the amps
+ * of its bus through tasdevice_chn_mine(); bus 0 runs in the caller.
+ * Returns after all of them are done, with the first error if any.
+ */
+int tasdevice_bus_parallel(struct tasdevice_priv *tas_priv,
+	int (*fn)(struct tasdevice_priv *tas_priv, void *arg), void *arg)
+{
+	struct tasdevice_bus *bus;
+	int i, ret;
+
+	if (tas_priv->nbus < 2)
+		return fn(tas_priv, arg);
+
+	for (i = 1; i < tas_priv->nbus; i++) {
+		bus = &tas_priv->buses[i];
+		bus->load_fn = fn;
+		bus->load_arg = arg;
+		bus->load_ret = 0;
+		queue_work(system_unbound_wq, &bus->load_work);
+	}
+
+	bus = &tas_priv->buses[0];
+	WRITE_ONCE(bus->loader, current);
+	ret = fn(tas_priv, arg);
+	WRITE_ONCE(bus->loader, NULL);
+
+	for (i = 1; i < tas_priv->nbus; i++) {
+		bus = &tas_priv->buses[i];
+		flush_work(&bus->load_work);
+		if (!ret)
+			ret = bus->load_ret;
+	}
+	return ret;
+}
+
+void tasdevice_bus_setup(struct tasdevice_priv *tas_priv)
+{
+	struct tasdevice_bus *bus;
+	int i;
+
+	if (!tas_priv->nbus)
+		tas_priv->nbus = 1;
+	for (i = 0; i < tas_priv->nbus; i++) {
+		bus = &tas_priv->buses[i];
+		mutex_init(&bus->own_lock);
+		bus->lock = i ? &bus->own_lock : &tas_priv->dev_lock;
+		bus->priv = tas_priv;
+		INIT_WORK(&bus->load_work, tasdevice_bus_load_work);
+	}
+}
+
+/*
+ * Firmware and regbin delays: sleep on an hrtimer until due, at most
+ * delay_slack_us late. msleep() rounds up to jiffies and routinely
+ * doubles the short settle times the images ask for.
+ */
+void tasdevice_delay_until(ktime_t due)
+{
+	while (ktime_before(ktime_get(), due)) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout_range(&due,
+			(u64)delay_slack_us * NSEC_PER_USEC, HRTIMER_MODE_ABS);
+	}
+}
+
+void tasdevice_delay_ms(unsigned int ms)
+{
+	if (ms)
+		tasdevice_delay_until(ktime_add_ms(ktime_get(), ms));
 }
 
-static int tasdevice_regmap_update_bits(
-	struct tasdevice_priv *tas_priv, unsigned int reg,
-	unsigned int mask, unsigned int value)
+/* The chip(s) behind chn went back to defaults, forget what we knew */
+void tasdevice_regcache_drop(struct tasdevice_priv *tas_priv,
+	unsigned short chn)
+{
+	int i = (chn == tas_priv->ndev) ? 0 : chn;
+	int end = (chn == tas_priv->ndev) ? tas_priv->ndev + 1 : chn + 1;
+
+	for (; i < end; i++) {
+		if (tas_priv->tasdevice[i].regmap)
+			regcache_drop_region(tas_priv->tasdevice[i].regmap,
+				0, TASDEVICE_REG(255, 255, 127));
+		/* No profile switch by delta from here on */
+		tas_priv->tasdevice[i].mnAppliedRegConf = -1;
+	}
+}
+
+/*
+ * Keep the register caches honest after a successful write: a software
+ * reset invalidates them, and a broadcast write is replayed into each
+ * chip's cache only, so later reads need no bus access.
+ */
+static void tasdevice_post_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, const unsigned char *data,
+	unsigned int len)
+{
+	struct regmap *bcast = tas_priv->tasdevice[tas_priv->ndev].regmap;
+	struct regmap *map;
+	int i;
+
+	if (reg <= TASDEVICE_REG_SWRESET &&
+		reg + len > TASDEVICE_REG_SWRESET &&
+		(data[TASDEVICE_REG_SWRESET - reg] &
+		TASDEVICE_REG_SWRESET_RESET)) {
+		tasdevice_regcache_drop(tas_priv, chn);
+		return;
+	}
+
+	if (chn != tas_priv->ndev)
+		return;
+
+	for (i = 0; i < tas_priv->ndev; i++) {
+		map = tas_priv->tasdevice[i].regmap;
+		if (map == bcast)
+			continue;
+		regcache_cache_only(map, true);
+		regmap_bulk_write(map, reg, data, len);
+		regcache_cache_only(map, false);
+	}
+}
+
+/*
+ * The register caches double as the shadow of what each chip holds.
+ * True when every chip behind chn already has data[0..len) at reg, in
+ * which case the write can be skipped. Volatile or never-seen registers
+ * miss the cache in cache-only mode and therefore never match; the DSP
+ * books are volatile as a whole and so are always written.
+ */
+static bool tasdevice_shadow_holds(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, const unsigned char *data,
+	unsigned int len)
 {
-	int nResult = 0;
-	int retry_count = TASDEVICE_RETRY_COUNT;
+	int i = (chn == tas_priv->ndev) ? 0 : chn;
+	int end = (chn == tas_priv->ndev) ? tas_priv->ndev : chn + 1;
+	bool match = !tas_priv->force_full_write;
+	struct regmap *map;
+	unsigned int val = 0;
+	int k, ret;
 
-	while (retry_count--) {
-		nResult = regmap_update_bits(tas_priv->regmap, reg,
-			mask, value);
-		if (nResult >= 0)
+	for (; match && i < end; i++) {
+		if (tas_priv->tasdevice[i].bNoShadow) {
+			match = false;
 			break;
-		usleep_range(5000, 5050);
+		}
+		map = tas_priv->tasdevice[i].regmap;
+		regcache_cache_only(map, true);
+		for (k = 0; k < len; k++) {
+			ret = regmap_read(map, reg + k, &val);
+			if (ret < 0 || val != data[k]) {
+				match = false;
+				break;
+			}
+		}
+		regcache_cache_only(map, false);
 	}
-	if (retry_count == -1)
-		return TASDEVICE_ERROR_FAILED;
+	return match;
+}
+
+/* As above, for a write that is skipped on a match; counts the outcome */
+static bool tasdevice_shadow_match(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, const unsigned char *data,
+	unsigned int len)
+{
+	bool match = tasdevice_shadow_holds(tas_priv, chn, reg, data, len);
+
+	if (match)
+		atomic_long_add(len, &tas_priv->shadow_hits);
 	else
-		return 0;
+		atomic_long_add(len, &tas_priv->shadow_misses);
+	return match;
 }
 
-static int tasdevice_change_chn_book(
-	struct tasdevice_priv *tas_priv, unsigned short chn, int book)
+/*
+ * Whether the chip on chn is known to hold val at reg, no bus access.
+ * Nothing is skipped here, so shadow_hits/shadow_misses are left alone.
+ */
+bool tasdevice_dev_holds(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char val)
 {
-#ifdef CONFIG_TASDEV_CODEC_SPI
-	struct spi_device *clnt =
-		(struct spi_device *)tas_priv->client;
-#else
-	struct i2c_client *clnt =
-		(struct i2c_client *)tas_priv->client;
-#endif
-	bool chip_switching = false;
+	bool match;
+
+	if (chn >= tas_priv->ndev)
+		return false;
+	tasdevice_lock(tas_priv, chn);
+	match = tasdevice_shadow_holds(tas_priv, chn, reg, &val, 1);
+	tasdevice_unlock(tas_priv, chn);
+	return match;
+}
+
+static bool tasdevice_is_selector_reg(unsigned int reg)
+{
+	return TASDEVICE_PAGE_REG(reg) == TASDEVICE_PAGE_SELECT ||
+		(TASDEVICE_PAGE_REG(reg) == TASDEVICE_BOOKCTL_REG &&
+		TASDEVICE_PAGE_ID(reg) == TASDEVICE_BOOKCTL_PAGE);
+}
+
+/*
+ * Length of the run at the head of seq that can go out as one burst:
+ * consecutive registers on the same page, no delays, and no book/page
+ * selector in between, since those change where the rest would land.
+ */
+static int tasdevice_seq_run_len(const struct reg_sequence *seq, int n)
+{
+	int len = 1;
+
+	if (tasdevice_is_selector_reg(seq[0].reg) || seq[0].delay_us)
+		return 1;
+
+	while (len < n && seq[len].reg == seq[len - 1].reg + 1 &&
+		seq[len].reg / 128 == seq[0].reg / 128 &&
+		!seq[len].delay_us &&
+		!tasdevice_is_selector_reg(seq[len].reg))
+		len++;
+
+	return len;
+}
+
+/*
+ * Write a same-book sequence: runs found by tasdevice_seq_run_len()
+ * become one bulk transfer, everything else goes through
+ * regmap_multi_reg_write() in the original order.
+ */
+static int tasdevice_seq_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, const struct reg_sequence *regs, int num_regs)
+{
+	struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+	unsigned char vals[TASDEVICE_SEQ_CHUNK];
+	int i = 0, j = 0, k = 0, len = 0, n = 0;
 	int ret = 0;
 
-	if (chn < tas_priv->ndev) {
-		struct tasdevice_t *tasdev = &tas_priv->tasdevice[chn];
+	/*
+	 * Drop what the chips already hold before looking for runs. The
+	 * cache still holds the pre-sequence state here, so a register that
+	 * is written earlier in this chunk must always be kept.
+	 */
+	for (i = 0; i < num_regs; i++) {
+		for (k = 0; k < n && seq[k].reg != regs[i].reg; k++)
+			;
+		vals[0] = regs[i].def;
+		if (k == n && !regs[i].delay_us &&
+			tasdevice_shadow_match(tas_priv, chn, regs[i].reg,
+			vals, 1))
+			continue;
+		seq[n++] = regs[i];
+	}
 
-#ifdef CONFIG_TASDEV_CODEC_SPI
-		if (clnt->chip_select != tasdev->mnDevAddr) {
-			clnt->chip_select = tasdev->mnDevAddr;
-			chip_switching = true;
-		}
-#else
-		if (tas_priv->glb_addr.ref_cnt != 0) {
-			tas_priv->glb_addr.ref_cnt = 0;
-			tas_priv->glb_addr.cur_book = -1;
-		}
+	i = 0;
 
-		if (clnt->addr != tasdev->mnDevAddr) {
-			clnt->addr = tasdev->mnDevAddr;
-			chip_switching = true;
+	while (i < n) {
+		for (j = i; j < n; j++) {
+			len = tasdevice_seq_run_len(&seq[j], n - j);
+			if (len > 1)
+				break;
 		}
-#endif
-		if (tasdev->cur_book == book) {
-			if (chip_switching) {
-				/* All tas2781s share the same regmap, clear the page
-				 * inside regmap once switching to another tas2781.
-				 * Register 0 at any pages and any books inside tas2781
-				 * is the same one for page-switching. Book has already
-				 * inside the current tas2781.
-				 */
-				ret = tasdevice_regmap_write(tas_priv,
-					TASDEVICE_PAGE_SELECT, 0);
-				if (ret < 0)
-					dev_err(tas_priv->dev, "%s, E=%d\n", __func__, ret);
-			}
-		} else {
-			/* Book switching in other cases */
-			ret = tasdevice_regmap_write(tas_priv,
-				TASDEVICE_BOOKCTL_REG, book);
-			if (ret < 0) {
-				dev_err(tas_priv->dev, "%s, E=%d\n", __func__, ret);
+		if (j > i) {
+			ret = tasdevice_regmap_multi_write(tas_priv, chn,
+				&seq[i], j - i);
+			if (ret < 0)
 				goto out;
+			for (k = i; k < j; k++) {
+				vals[0] = seq[k].def;
+				tasdevice_post_write(tas_priv, chn, seq[k].reg,
+					vals, 1);
 			}
-			tasdev->cur_book = book;
-		}
-	} else if (chn == tas_priv->ndev) {
-		int i = 0;
-
-		if (tas_priv->glb_addr.ref_cnt == 0)
-			for (i = 0; i < tas_priv->ndev; i++)
-				tas_priv->tasdevice[i].cur_book = -1;
-
-		clnt->addr = tas_priv->glb_addr.dev_addr;
-		if (tas_priv->glb_addr.cur_book != book) {
-			ret = tasdevice_regmap_write(tas_priv,
-				TASDEVICE_BOOKCTL_REG, book);
-			if (ret < 0) {
-				dev_err(tas_priv->dev,
-					"%s, book%xERROR, E=%d\n",
-					__func__, book, ret);
-				goto out;
-			}
-			tas_priv->glb_addr.cur_book = book;
 		}
+		if (j == n)
+			break;
 
-		tas_priv->glb_addr.ref_cnt++;
-	} else
+		for (k = 0; k < len; k++)
+			vals[k] = seq[j + k].def;
+		ret = tasdevice_regmap_bulk_write(tas_priv, chn,
+			seq[j].reg, vals, len);
+		if (ret < 0)
+			goto out;
+		tasdevice_post_write(tas_priv, chn, seq[j].reg, vals, len);
+		atomic_long_add(len - 1, &tas_priv->saved_xfers);
+		i = j + len;
+	}
+out:
+	return ret;
+}
+
+/*
+ * Every channel has its own client and regmap, and book/page are
+ * selected by the regmap bus on demand, so there is nothing to
+ * switch here beyond validating the channel.
+ */
+static int tasdevice_change_chn_book(
+	struct tasdevice_priv *tas_priv, unsigned short chn, int book)
+{
+	if (chn > tas_priv->ndev || !tas_priv->tasdevice[chn].regmap) {
 		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
 			__func__, chn);
+		return -EINVAL;
+	}
+	tas_priv->act_chn = chn;
 
-out:
-	return ret;
+	return 0;
 }
 
 int tasdevice_dev_read(struct tasdevice_priv *tas_priv,
@@ -214,15 +800,14 @@ int tasdevice_dev_read(struct tasdevice_priv *tas_priv,
 {
 	int ret = 0;
 
-	mutex_lock(&tas_priv->dev_lock);
+	tasdevice_lock(tas_priv, chn);
 	if (chn < tas_priv->ndev) {
 		ret = tasdevice_change_chn_book(tas_priv, chn,
 			TASDEVICE_BOOK_ID(reg));
 		if (ret < 0)
 			goto out;
 
-		ret = tasdevice_regmap_read(tas_priv,
-			TASDEVICE_PGRG(reg), pValue);
+		ret = tasdevice_regmap_read(tas_priv, chn, reg, pValue);
 		if (ret < 0)
 			dev_err(tas_priv->dev, "%s, ERROR,E=%d\n",
 				__func__, ret);
@@ -238,7 +823,7 @@ int tasdevice_dev_read(struct tasdevice_priv *tas_priv,
 			__func__, chn);
 
 out:
-	mutex_unlock(&tas_priv->dev_lock);
+	tasdevice_unlock(tas_priv, chn);
 	return ret;
 }
 
@@ -246,21 +831,26 @@ out:
 int tasdevice_dev_write(struct tasdevice_priv *tas_priv,
 	unsigned short chn, unsigned int reg, unsigned int value)
 {
+	unsigned char val = 0;
 	int ret = 0;
 
-	mutex_lock(&tas_priv->dev_lock);
+	tasdevice_lock(tas_priv, chn);
 	if (chn <= tas_priv->ndev) {
 		ret = tasdevice_change_chn_book(tas_priv, chn,
 			TASDEVICE_BOOK_ID(reg));
 		if (ret < 0)
 			goto out;
 
-		ret = tasdevice_regmap_write(tas_priv,
-			TASDEVICE_PGRG(reg), value);
+		val = value;
+		if (tasdevice_shadow_match(tas_priv, chn, reg, &val, 1))
+			goto out;
+
+		ret = tasdevice_regmap_write(tas_priv, chn, reg, value);
 		if (ret < 0)
 			dev_err(tas_priv->dev, "%s, ERROR, E=%d\n",
 				__func__, ret);
-		else
+		else {
+			tasdevice_post_write(tas_priv, chn, reg, &val, 1);
 			dev_dbg(tas_priv->dev,
 				"%s: %s-0x%02x:BOOK:PAGE:REG 0x%02x:0x%02x:0x%02x, VAL: 0x%02x\n",
 				__func__, (chn == tas_priv->ndev)?"glb":"chn",
@@ -270,15 +860,96 @@ int tasdevice_dev_write(struct tasdevice_priv *tas_priv,
 				TASDEVICE_BOOK_ID(reg),
 				TASDEVICE_PAGE_ID(reg),
 				TASDEVICE_PAGE_REG(reg), value);
+		}
 	} else
 		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
 			__func__, chn);
 out:
-	mutex_unlock(&tas_priv->dev_lock);
+	tasdevice_unlock(tas_priv, chn);
 	return ret;
 }
 
 
+/*
+ * Apply a whole register sequence to one channel, or to the broadcast
+ * channel when chn == ndev. Each reg is TASDEVICE_REG() encoded. The
+ * writes are issued in order under a single bus lock acquisition, book
+ * and page selectors are only written when they change, and runs of
+ * consecutive registers are merged into burst transfers.
+ */
+int tasdevice_dev_multi_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, const struct reg_sequence *regs, int num_regs)
+{
+	struct reg_sequence seq[TASDEVICE_SEQ_CHUNK];
+	int i = 0, n = 0, book = 0;
+	int ret = 0;
+
+	tasdevice_lock(tas_priv, chn);
+	if (chn > tas_priv->ndev) {
+		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
+			__func__, chn);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	while (i < num_regs) {
+		book = TASDEVICE_BOOK_ID(regs[i].reg);
+		ret = tasdevice_change_chn_book(tas_priv, chn, book);
+		if (ret < 0)
+			goto out;
+
+		for (n = 0; i < num_regs && n < TASDEVICE_SEQ_CHUNK &&
+			TASDEVICE_BOOK_ID(regs[i].reg) == book; i++, n++) {
+			seq[n].reg = regs[i].reg;
+			seq[n].def = regs[i].def;
+			seq[n].delay_us = regs[i].delay_us;
+		}
+
+		ret = tasdevice_seq_write(tas_priv, chn, seq, n);
+		if (ret < 0) {
+			dev_err(tas_priv->dev, "%s, ERROR, E=%d\n",
+				__func__, ret);
+			goto out;
+		}
+	}
+	dev_dbg(tas_priv->dev, "%s: %s-0x%02x: %d regs\n", __func__,
+		(chn == tas_priv->ndev) ? "glb" : "chn",
+		(chn == tas_priv->ndev) ? tas_priv->glb_addr.dev_addr :
+		tas_priv->tasdevice[chn].mnDevAddr, num_regs);
+out:
+	tasdevice_unlock(tas_priv, chn);
+	return ret;
+}
+
+/*
+ * Large writes go out in preempt_chunk pieces with a preemption point in
+ * between, so a control write waits for one piece, not the whole burst.
+ * Outside a preemptible session the points are no-ops and the pieces go
+ * out back to back.
+ */
+static int tasdevice_bulk_write_chunked(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char *p_data,
+	unsigned int n_length)
+{
+	unsigned int len;
+	int ret = 0;
+
+	while (n_length) {
+		len = preempt_chunk ? min(n_length, preempt_chunk) : n_length;
+		ret = tasdevice_regmap_bulk_write(tas_priv, chn, reg, p_data,
+			len);
+		if (ret < 0)
+			break;
+		tasdevice_post_write(tas_priv, chn, reg, p_data, len);
+		reg += len;
+		p_data += len;
+		n_length -= len;
+		if (n_length)
+			tasdevice_yield(tas_priv, chn);
+	}
+	return ret;
+}
+
 int tasdevice_dev_bulk_write(
 	struct tasdevice_priv *tas_priv, unsigned short chn,
 	unsigned int reg, unsigned char *p_data,
@@ -286,19 +957,23 @@ int tasdevice_dev_bulk_write(
 {
 	int ret = 0;
 
-	mutex_lock(&tas_priv->dev_lock);
+	tasdevice_lock(tas_priv, chn);
 	if (chn <= tas_priv->ndev) {
 		ret = tasdevice_change_chn_book(tas_priv, chn,
 			TASDEVICE_BOOK_ID(reg));
 		if (ret < 0)
 			goto out;
 
-		ret = tasdevice_regmap_bulk_write(tas_priv,
-			TASDEVICE_PGRG(reg), p_data, n_length);
+		if (tasdevice_shadow_match(tas_priv, chn, reg, p_data,
+			n_length))
+			goto out;
+
+		ret = tasdevice_bulk_write_chunked(tas_priv, chn, reg, p_data,
+			n_length);
 		if (ret < 0)
 			dev_err(tas_priv->dev, "%s, ERROR, E=%d\n",
 				__func__, ret);
-		else
+		else {
 			dev_dbg(tas_priv->dev,
 				"%s: %s-0x%02x:BOOK:PAGE:REG 0x%02x:0x%02x: 0x%02x, len: 0x%02x\n",
 				__func__,
@@ -308,11 +983,12 @@ int tasdevice_dev_bulk_write(
 				: tas_priv->tasdevice[chn].mnDevAddr,
 				TASDEVICE_BOOK_ID(reg), TASDEVICE_PAGE_ID(reg),
 				TASDEVICE_PAGE_REG(reg), n_length);
+		}
 	} else
 		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
 			__func__, chn);
 out:
-	mutex_unlock(&tas_priv->dev_lock);
+	tasdevice_unlock(tas_priv, chn);
 	return ret;
 }
 
@@ -323,15 +999,15 @@ int tasdevice_dev_bulk_read(struct tasdevice_priv *tas_priv,
 {
 	int ret = 0;
 
-	mutex_lock(&tas_priv->dev_lock);
+	tasdevice_lock(tas_priv, chn);
 	if (chn < tas_priv->ndev) {
 		ret = tasdevice_change_chn_book(tas_priv, chn,
 			TASDEVICE_BOOK_ID(reg));
 		if (ret < 0)
 			goto out;
 
-		ret = tasdevice_regmap_bulk_read(tas_priv,
-			TASDEVICE_PGRG(reg), p_data, n_length);
+		ret = tasdevice_regmap_bulk_read(tas_priv, chn, reg, p_data,
+			n_length);
 		if (ret < 0)
 			dev_err(tas_priv->dev, "%s, ERROR, E=%d\n",
 				__func__, ret);
@@ -347,26 +1023,150 @@ int tasdevice_dev_bulk_read(struct tasdevice_priv *tas_priv,
 			__func__, chn);
 
 out:
-	mutex_unlock(&tas_priv->dev_lock);
+	tasdevice_unlock(tas_priv, chn);
 	return ret;
 }
 
 
+/*
+ * Read back from the chip itself, bypassing the register cache, for
+ * callers that verify what actually landed (e.g. YRAM checksums).
+ */
+int tasdevice_dev_bulk_read_nocache(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char *p_data,
+	unsigned int n_length)
+{
+	struct regmap *map;
+	int ret = 0;
+
+	tasdevice_lock(tas_priv, chn);
+	if (chn >= tas_priv->ndev) {
+		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
+			__func__, chn);
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = tasdevice_change_chn_book(tas_priv, chn,
+		TASDEVICE_BOOK_ID(reg));
+	if (ret < 0)
+		goto out;
+
+	map = tas_priv->tasdevice[chn].regmap;
+	regcache_cache_bypass(map, true);
+	ret = tasdevice_regmap_bulk_read(tas_priv, chn, reg, p_data,
+		n_length);
+	regcache_cache_bypass(map, false);
+	if (ret < 0)
+		dev_err(tas_priv->dev, "%s, ERROR, E=%d\n", __func__, ret);
+out:
+	tasdevice_unlock(tas_priv, chn);
+	return ret;
+}
+
+/* One register straight from the chip, for the debug and tuning paths */
+int tasdevice_dev_read_nocache(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned int *val)
+{
+	unsigned char data = 0;
+	int ret;
+
+	ret = tasdevice_dev_bulk_read_nocache(tas_priv, chn, reg, &data, 1);
+	*val = data;
+	return ret;
+}
+
+/*
+ * Write a block and read it straight back, for callers that verify what
+ * actually landed (e.g. YRAM checksums). The I2C bus does it in one
+ * combined transfer; buses that can't (SPI, SMBus or adapters with
+ * quirks) fall back to a write followed by an uncached read. Must not
+ * cross a page.
+ */
+int tasdevice_dev_verified_write(struct tasdevice_priv *tas_priv,
+	unsigned short chn, unsigned int reg, unsigned char *p_data,
+	unsigned char *p_rb, unsigned int n_length)
+{
+	struct tasdevice_t *tasdev;
+	struct regmap *map;
+	int ret = 0, attempt = 0;
+	u64 t0;
+
+	tasdevice_lock(tas_priv, chn);
+	if (chn >= tas_priv->ndev) {
+		dev_err(tas_priv->dev, "%s, ERROR, no such channel(%d)\n",
+			__func__, chn);
+		ret = -EINVAL;
+		goto out;
+	}
+	if (!n_length || TASDEVICE_PAGE_REG(reg) + n_length > 128) {
+		dev_err(tas_priv->dev, "%s, ERROR, len %u crosses a page\n",
+			__func__, n_length);
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = tasdevice_change_chn_book(tas_priv, chn,
+		TASDEVICE_BOOK_ID(reg));
+	if (ret < 0)
+		goto out;
+
+	tasdev = &tas_priv->tasdevice[chn];
+	map = tasdev->regmap;
+	if (!tas_priv->write_readback ||
+		!tasdevice_chn_bus(tas_priv, chn)->readback) {
+		ret = tasdevice_regmap_bulk_write(tas_priv, chn, reg, p_data,
+			n_length);
+		if (ret < 0)
+			goto err;
+		tasdevice_post_write(tas_priv, chn, reg, p_data, n_length);
+		regcache_cache_bypass(map, true);
+		ret = tasdevice_regmap_bulk_read(tas_priv, chn, reg, p_rb,
+			n_length);
+		regcache_cache_bypass(map, false);
+		goto err;
+	}
+
+	t0 = ktime_get_ns();
+	ret = tasdevice_breaker_check(tas_priv, chn);
+	if (ret == 0) {
+		do {
+			ret = tas_priv->write_readback(tasdev, reg, p_data,
+				p_rb, n_length);
+		} while (tasdevice_retry(tas_priv, chn, ret, attempt++));
+	}
+	tasdevice_io_done(tas_priv, chn, TASDEVICE_IO_WRITE_READBACK, reg,
+		n_length, ret, attempt, t0);
+	if (ret < 0)
+		goto err;
+
+	/* The bus went around regmap, bring the cache up to date */
+	regcache_cache_only(map, true);
+	regmap_bulk_write(map, reg, p_data, n_length);
+	regcache_cache_only(map, false);
+	tasdevice_post_write(tas_priv, chn, reg, p_data, n_length);
+	tasdev->bus_stats.readback_merged++;
+err:
+	if (ret < 0)
+		dev_err(tas_priv->dev, "%s, ERROR, E=%d\n", __func__, ret);
+out:
+	tasdevice_unlock(tas_priv, chn);
+	return ret;
+}
+
 int tasdevice_dev_update_bits(struct tasdevice_priv *tas_priv,
 	unsigned short chn, unsigned int reg, unsigned int mask,
 	unsigned int value)
 {
 	int ret = 0;
 
-	mutex_lock(&tas_priv->dev_lock);
+	tasdevice_lock(tas_priv, chn);
 	if (chn < tas_priv->ndev) {
 		ret = tasdevice_change_chn_book(tas_priv, chn,
 			TASDEVICE_BOOK_ID(reg));
 		if (ret < 0)
 			goto out;
 
-		ret = tasdevice_regmap_update_bits(tas_priv,
-			TASDEVICE_PGRG(reg), mask, value);
+		ret = tasdevice_regmap_update_bits(tas_priv, chn, reg, mask,
+			value);
 		if (ret < 0)
 			dev_err(tas_priv->dev, "%s, ERROR, E=%d\n",
 				__func__, ret);
@@ -382,7 +1182,7 @@ int tasdevice_dev_update_bits(struct tasdevice_priv *tas_priv,
 			__func__, chn);
 
 out:
-	mutex_unlock(&tas_priv->dev_lock);
+	tasdevice_unlock(tas_priv, chn);
 	return ret;
 }
 
@@ -15,12 +15,33 @@
 
 #ifndef __TASDEVICE_RW_H__
 #define __TASDEVICE_RW_H__
+int tasdevice_session_begin(struct tasdevice_priv *pPcmdev,
+	unsigned short chn);
+int tasdevice_session_begin_preempt(struct tasdevice_priv *pPcmdev,
+	unsigned short chn);
+void tasdevice_session_end(struct tasdevice_priv *pPcmdev,
+	unsigned short chn);
+bool tasdevice_chn_mine(struct tasdevice_priv *pPcmdev, unsigned short chn);
+struct mutex *tasdevice_chn_lock(struct tasdevice_priv *pPcmdev,
+	unsigned short chn);
+int tasdevice_bus_parallel(struct tasdevice_priv *pPcmdev,
+	int (*fn)(struct tasdevice_priv *tas_priv, void *arg), void *arg);
+void tasdevice_bus_setup(struct tasdevice_priv *pPcmdev);
+void tasdevice_prio_begin(struct tasdevice_priv *pPcmdev);
+void tasdevice_prio_end(struct tasdevice_priv *pPcmdev);
+void tasdevice_delay_until(ktime_t due);
+void tasdevice_delay_ms(unsigned int ms);
+
 int tasdevice_dev_read(struct tasdevice_priv *pPcmdev,
 	unsigned short chn, unsigned int reg, unsigned int *pValue);
 
 int tasdevice_dev_write(struct tasdevice_priv *pPcmdev,
 	unsigned short chn, unsigned int reg, unsigned int value);
 
+int tasdevice_dev_multi_write(struct tasdevice_priv *pPcmdev,
+	unsigned short chn, const struct reg_sequence *regs,
+	int num_regs);
+
 int tasdevice_dev_bulk_write(
 	struct tasdevice_priv *pPcmdev, unsigned short chn,
 	unsigned int reg, unsigned char *p_data, unsigned int n_length);
@@ -32,4 +53,18 @@ int tasdevice_dev_bulk_read(struct tasdevice_priv *pPcmdev,
 int tasdevice_dev_update_bits(
 	struct tasdevice_priv *pPcmdev, unsigned short chn,
 	unsigned int reg, unsigned int mask, unsigned int value);
+
+int tasdevice_dev_bulk_read_nocache(struct tasdevice_priv *pPcmdev,
+	unsigned short chn, unsigned int reg, unsigned char *p_data,
+	unsigned int n_length);
+int tasdevice_dev_read_nocache(struct tasdevice_priv *pPcmdev,
+	unsigned short chn, unsigned int reg, unsigned int *val);
+int tasdevice_dev_verified_write(struct tasdevice_priv *pPcmdev,
+	unsigned short chn, unsigned int reg, unsigned char *p_data,
+	unsigned char *p_rb, unsigned int n_length);
+
+void tasdevice_regcache_drop(struct tasdevice_priv *pPcmdev,
+	unsigned short chn);
+bool tasdevice_dev_holds(struct tasdevice_priv *pPcmdev,
+	unsigned short chn, unsigned int reg, unsigned char val);
 #endif
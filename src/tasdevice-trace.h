@@ -0,0 +1,202 @@
+/*
+ * TAS2563/TAS2871 Linux Driver
+ *
+ * Copyright (C) 2022 - 2024 Texas Instruments Incorporated
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tasdevice
+
+#if !defined(__TASDEVICE_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __TASDEVICE_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(TASDEVICE_IO_READ);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_WRITE);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_BULK_READ);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_BULK_WRITE);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_UPDATE_BITS);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_MULTI_WRITE);
+TRACE_DEFINE_ENUM(TASDEVICE_IO_WRITE_READBACK);
+
+#define show_tasdevice_io_op(op)					\
+	__print_symbolic(op,						\
+		{ TASDEVICE_IO_READ,		"read" },		\
+		{ TASDEVICE_IO_WRITE,		"write" },		\
+		{ TASDEVICE_IO_BULK_READ,	"bulk_read" },		\
+		{ TASDEVICE_IO_BULK_WRITE,	"bulk_write" },		\
+		{ TASDEVICE_IO_UPDATE_BITS,	"update_bits" },	\
+		{ TASDEVICE_IO_MULTI_WRITE,	"multi_write" },	\
+		{ TASDEVICE_IO_WRITE_READBACK,	"write_readback" })
+
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_REGBIN);
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_DSPFW);
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_PROGRAM);
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_CONFIG);
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_CALIBRATION);
+TRACE_DEFINE_ENUM(TASDEVICE_LOAD_REGBIN_CFG);
+
+#define show_tasdevice_load_phase(phase)				\
+	__print_symbolic(phase,						\
+		{ TASDEVICE_LOAD_REGBIN,	"regbin" },		\
+		{ TASDEVICE_LOAD_DSPFW,		"dspfw" },		\
+		{ TASDEVICE_LOAD_PROGRAM,	"program" },		\
+		{ TASDEVICE_LOAD_CONFIG,	"configuration" },	\
+		{ TASDEVICE_LOAD_CALIBRATION,	"calibration" },	\
+		{ TASDEVICE_LOAD_REGBIN_CFG,	"regbin_cfg" })
+
+/* One register access through the retry engine, all attempts included */
+TRACE_EVENT(tasdevice_io,
+	TP_PROTO(unsigned short chn, unsigned int addr, int op,
+		unsigned int reg, unsigned int len, int ret, int retries,
+		u64 ns),
+	TP_ARGS(chn, addr, op, reg, len, ret, retries, ns),
+	TP_STRUCT__entry(
+		__field(unsigned short, chn)
+		__field(unsigned int, addr)
+		__field(int, op)
+		__field(unsigned int, reg)
+		__field(unsigned int, len)
+		__field(int, ret)
+		__field(int, retries)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		__entry->chn = chn;
+		__entry->addr = addr;
+		__entry->op = op;
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->ret = ret;
+		__entry->retries = retries;
+		__entry->ns = ns;
+	),
+	TP_printk("chn=%u addr=0x%02x %s B0x%02x P0x%02x R0x%02x len=%u "
+		"ret=%d retries=%d ns=%llu", __entry->chn, __entry->addr,
+		show_tasdevice_io_op(__entry->op),
+		TASDEVICE_BOOK_ID(__entry->reg),
+		TASDEVICE_PAGE_ID(__entry->reg),
+		TASDEVICE_PAGE_REG(__entry->reg), __entry->len,
+		__entry->ret, __entry->retries, __entry->ns)
+);
+
+DECLARE_EVENT_CLASS(tasdevice_select,
+	TP_PROTO(unsigned short chn, unsigned int addr, unsigned char val,
+		int ret),
+	TP_ARGS(chn, addr, val, ret),
+	TP_STRUCT__entry(
+		__field(unsigned short, chn)
+		__field(unsigned int, addr)
+		__field(unsigned char, val)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->chn = chn;
+		__entry->addr = addr;
+		__entry->val = val;
+		__entry->ret = ret;
+	),
+	TP_printk("chn=%u addr=0x%02x 0x%02x ret=%d", __entry->chn,
+		__entry->addr, __entry->val, __entry->ret)
+);
+
+/* Selector writes issued by the regmap bus */
+DEFINE_EVENT(tasdevice_select, tasdevice_book_switch,
+	TP_PROTO(unsigned short chn, unsigned int addr, unsigned char val,
+		int ret),
+	TP_ARGS(chn, addr, val, ret)
+);
+
+DEFINE_EVENT(tasdevice_select, tasdevice_page_switch,
+	TP_PROTO(unsigned short chn, unsigned int addr, unsigned char val,
+		int ret),
+	TP_ARGS(chn, addr, val, ret)
+);
+
+/* One DSP firmware block, broadcast or per device */
+TRACE_EVENT(tasdevice_block_begin,
+	TP_PROTO(unsigned int type, unsigned char dev_idx, bool bcast,
+		unsigned int size),
+	TP_ARGS(type, dev_idx, bcast, size),
+	TP_STRUCT__entry(
+		__field(unsigned int, type)
+		__field(unsigned char, dev_idx)
+		__field(bool, bcast)
+		__field(unsigned int, size)
+	),
+	TP_fast_assign(
+		__entry->type = type;
+		__entry->dev_idx = dev_idx;
+		__entry->bcast = bcast;
+		__entry->size = size;
+	),
+	TP_printk("type=0x%02x dev_idx=0x%02x bcast=%d size=%u",
+		__entry->type, __entry->dev_idx, __entry->bcast,
+		__entry->size)
+);
+
+TRACE_EVENT(tasdevice_block_end,
+	TP_PROTO(unsigned int type, int ret),
+	TP_ARGS(type, ret),
+	TP_STRUCT__entry(
+		__field(unsigned int, type)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->type = type;
+		__entry->ret = ret;
+	),
+	TP_printk("type=0x%02x ret=%d", __entry->type, __entry->ret)
+);
+
+/* Firmware parse and download stages; idx is the prog/conf/profile */
+TRACE_EVENT(tasdevice_load_begin,
+	TP_PROTO(int phase, int idx),
+	TP_ARGS(phase, idx),
+	TP_STRUCT__entry(
+		__field(int, phase)
+		__field(int, idx)
+	),
+	TP_fast_assign(
+		__entry->phase = phase;
+		__entry->idx = idx;
+	),
+	TP_printk("%s idx=%d", show_tasdevice_load_phase(__entry->phase),
+		__entry->idx)
+);
+
+TRACE_EVENT(tasdevice_load_end,
+	TP_PROTO(int phase, int idx, int ret),
+	TP_ARGS(phase, idx, ret),
+	TP_STRUCT__entry(
+		__field(int, phase)
+		__field(int, idx)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->phase = phase;
+		__entry->idx = idx;
+		__entry->ret = ret;
+	),
+	TP_printk("%s idx=%d ret=%d",
+		show_tasdevice_load_phase(__entry->phase), __entry->idx,
+		__entry->ret)
+);
+
+#endif /* __TASDEVICE_TRACE_H__ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tasdevice-trace
+#include <trace/define_trace.h>
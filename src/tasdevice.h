@@ -15,8 +15,11 @@
 
 #ifndef __TASDEVICE_H__
 #define __TASDEVICE_H__
+#include <linux/crc8.h>
+#include <linux/firmware.h>
 #include "tasdevice-regbin.h"
 #include "tasdevice-dsp.h"
+#include <linux/completion.h>
 #include <linux/miscdevice.h>
 #include <linux/regmap.h>
 #include <linux/init.h>
@@ -32,6 +35,7 @@
 #define TASDEVICE_RETRY_COUNT			3
 #define TASDEVICE_ERROR_FAILED			-2
 #define TASDEVICE_MAX_DOWNLOAD_CNT		3
+#define TASDEVICE_SEQ_CHUNK			32
 
 #define TASDEVICE_RATES	(SNDRV_PCM_RATE_44100 |\
 	SNDRV_PCM_RATE_48000 | SNDRV_PCM_RATE_96000 |\
@@ -84,16 +88,77 @@ enum audio_device {
 	TAS2781,
 };
 
+/* Register access kinds, as seen in traces */
+enum tasdevice_io_op {
+	TASDEVICE_IO_READ,
+	TASDEVICE_IO_WRITE,
+	TASDEVICE_IO_BULK_READ,
+	TASDEVICE_IO_BULK_WRITE,
+	TASDEVICE_IO_UPDATE_BITS,
+	TASDEVICE_IO_MULTI_WRITE,
+	TASDEVICE_IO_WRITE_READBACK,
+};
+
+/* Firmware parse and download stages, as seen in traces */
+enum tasdevice_load_phase {
+	TASDEVICE_LOAD_REGBIN,
+	TASDEVICE_LOAD_DSPFW,
+	TASDEVICE_LOAD_PROGRAM,
+	TASDEVICE_LOAD_CONFIG,
+	TASDEVICE_LOAD_CALIBRATION,
+	TASDEVICE_LOAD_REGBIN_CFG,
+};
+
+/* Latency histograms, bucket n counts accesses of 2^(n-1) to 2^n us */
+#define TASDEVICE_LAT_BUCKETS		20
+
+struct tasdevice_bus_stats {
+	unsigned long retries;
+	unsigned long failures;
+	unsigned long breaker_trips;
+	unsigned long fast_fails;
+	/* Downloads that stepped aside for a control write */
+	unsigned long yields;
+	/* Verified writes whose readback rode on the write transfer */
+	unsigned long readback_merged;
+	unsigned long xfers;
+	unsigned long bytes_wr;
+	unsigned long bytes_rd;
+	unsigned long book_switches;
+	unsigned long page_switches;
+	unsigned long lat_single[TASDEVICE_LAT_BUCKETS];
+	unsigned long lat_bulk[TASDEVICE_LAT_BUCKETS];
+};
+
 struct tasdevice_t {
 	unsigned int mnDevAddr;
 	unsigned int mnErrCode;
-	unsigned char cur_book;
+	/* Own client and regmap, the primary client for the first chip */
+	void *client;
+	struct regmap *regmap;
+	struct tasdevice_priv *priv;
+	/* DMA-safe transfer buffers, SPI only */
+	unsigned char *tx_buf;
+	unsigned char *rx_buf;
+	/* Last book/page selected on the chip, -1 when unknown */
+	int cur_book;
+	int cur_page;
+	/* Index into tasdevice_priv.buses */
+	unsigned char bus;
 	short mnCurrentProgram;
 	short mnCurrentConfiguration;
 	short mnCurrentRegConf;
+	/* Profile whose PRE_POWER_UP the chip holds, -1 if unknown */
+	short mnAppliedRegConf;
 	int prg_download_cnt;
 	bool bLoading;
 	bool bLoaderr;
+	/* Always write, the block is covered by the I2C checksum */
+	bool bNoShadow;
+	/* Retry engine and circuit breaker state */
+	struct tasdevice_bus_stats bus_stats;
+	unsigned int consec_fail;
+	unsigned long breaker_until;
 	struct tasdevice_fw *mpCalFirmware;
 };
 
@@ -146,9 +211,54 @@ struct tasdev_buf {
 *  writes, useless in mono case.
 */
 struct global_addr {
-	unsigned char cur_book;
 	unsigned int dev_addr;
-	int ref_cnt;
+};
+
+/*
+ * One per I2C adapter the amps sit on. Bus 0 locks with dev_lock, so a
+ * single-adapter setup behaves as it always did; further buses have a
+ * lock of their own and download at the same time as bus 0.
+ */
+struct tasdevice_bus {
+	/* struct i2c_adapter of the bus */
+	void *adapter;
+	/* Payload limits of one transfer, register byte not included */
+	size_t max_wr;
+	size_t max_rd;
+	/* SMBus-only adapter, I2C block transfers carry the data */
+	bool smbus;
+	/* Write and readback may go out as one combined transfer */
+	bool readback;
+	struct mutex *lock;
+	struct mutex own_lock;
+	/* Task holding lock through tasdevice_session_begin() */
+	struct task_struct *session_owner;
+	int session_depth;
+	/* The session is a download that control writes may cut into */
+	bool session_preempt;
+	/* Worker state for tasdevice_bus_parallel() */
+	struct tasdevice_priv *priv;
+	struct task_struct *loader;
+	struct work_struct load_work;
+	int (*load_fn)(struct tasdevice_priv *tas_priv, void *arg);
+	void *load_arg;
+	int load_ret;
+};
+
+/*
+ * Control value waiting to be written by ctl_work. A later put to the
+ * same register replaces it, only the latest one reaches the amps.
+ */
+#define TASDEVICE_CTL_SLOTS		4
+
+struct tasdevice_ctl_write {
+	unsigned int reg;
+	/* update_bits on every amp when non-zero */
+	unsigned int mask;
+	unsigned char val[4];
+	/* 0: slot unused */
+	unsigned char len;
+	bool pending;
 };
 
 struct tasdevice_priv {
@@ -157,12 +267,23 @@ struct tasdevice_priv {
 	struct regmap *regmap;
 	struct miscdevice misc_dev;
 	struct mutex dev_lock;
+	struct tasdevice_bus buses[TASDEVICE_MAX_CHANNELS];
+	unsigned char nbus;
+	/* Control writes waiting for the bus, see tasdevice_prio_begin() */
+	atomic_t prio_waiters;
+	wait_queue_head_t prio_wq;
 	struct mutex file_lock;
-	struct tasdevice_t tasdevice[TASDEVICE_MAX_CHANNELS];
+	/* tasdevice[ndev] is the broadcast instance at glb_addr.dev_addr */
+	struct tasdevice_t tasdevice[TASDEVICE_MAX_CHANNELS + 1];
 	struct Trwinfo rwinfo;
 	struct Tsyscmd nSysCmd[MaxCmd];
 	struct tasdevice_fw *fmw;
 	struct tasdevice_regbin mtRegbin;
+	/* Reloaded regbin waiting for the next stream start, under codec_lock */
+	struct tasdevice_regbin *regbin_next;
+	/* Done unless a reload callback is still to run */
+	struct completion regbin_reload_done;
+	bool regbin_reload_off;
 	struct tasdevice_irqinfo irq_info;
 	struct tas_control tas_ctrl;
 	struct global_addr glb_addr;
@@ -178,8 +299,19 @@ struct tasdevice_priv {
 		unsigned int reg, unsigned char *pData, unsigned int len);
 	int (*bulk_write)(struct tasdevice_priv *tas_dev, unsigned short chn,
 		unsigned int reg, unsigned char *pData, unsigned int len);
+	int (*multi_write)(struct tasdevice_priv *tas_dev, unsigned short chn,
+		const struct reg_sequence *regs, int num_regs);
 	int (*update_bits)(struct tasdevice_priv *tas_dev, unsigned short chn,
 		unsigned int reg, unsigned int mask, unsigned int value);
+	/* Single-page transfers under the regmaps, see tasdevice-regmap.c */
+	int (*bus_send)(struct tasdevice_t *tasdev, unsigned char reg,
+		const unsigned char *val, size_t len);
+	int (*bus_recv)(struct tasdevice_t *tasdev, unsigned int reg,
+		unsigned char *val, size_t len);
+	/* Write and read back in one bus transaction, NULL if unsupported */
+	int (*write_readback)(struct tasdevice_t *tasdev, unsigned int reg,
+		const unsigned char *data, unsigned char *rb,
+		unsigned int len);
 	int (*set_calibration)(void *pTAS2563, unsigned short chl,
 		int calibration);
 	void (*set_global_mode)(struct tasdevice_priv *tas_dev);
@@ -196,6 +328,14 @@ struct tasdevice_priv {
 		const struct firmware *pFW, int offset);
 	void (*irq_work_func)(struct tasdevice_priv *pcm_dev);
 	int fw_state;
+	/* Channel of the last register access, for act_addr */
+	unsigned short act_chn;
+	/* I2C/SPI transactions avoided by burst coalescing, bumped per bus */
+	atomic_long_t saved_xfers;
+	/* Registers skipped/written after comparing with the cache */
+	atomic_long_t shadow_hits;
+	atomic_long_t shadow_misses;
+	bool force_full_write;
 	unsigned int magic_num;
 	int mnSPIEnable;
 	unsigned char ndev;
@@ -211,7 +351,13 @@ struct tasdevice_priv {
 	int cstream;
 	struct mutex codec_lock;
 	struct delayed_work powercontrol_work;
+	spinlock_t ctl_lock;
+	struct tasdevice_ctl_write ctl_writes[TASDEVICE_CTL_SLOTS];
+	/* Non-zero: puts are parked only, see tasdevice_ctl_hold() */
+	int ctl_hold;
+	struct work_struct ctl_work;
 	struct tasdev_buf calbin_buf;
+	struct dentry *debugfs_dir;
 };
 
 extern const char *blocktype[5];
@@ -224,7 +370,6 @@ extern const struct dev_pm_ops tasdevice_pm_ops;
 extern const struct of_device_id tasdevice_of_match[];
 
 int tasdevice_create_controls(struct tasdevice_priv *tas_dev);
-int tasdevice_parse_dt(struct tasdevice_priv *tas_dev);
 int tasdevice_probe_next(struct tasdevice_priv *tas_dev);
 void tasdevice_parse_dt_reset_irq_pin(
 	struct tasdevice_priv *tas_priv, struct device_node *np);